@@ -0,0 +1,158 @@
+#include "AnimationClip.h"
+#include <xmmintrin.h>
+
+using namespace vmath;
+
+namespace soft3d
+{
+
+	AnimationClip::AnimationClip(uint32 nodeCount, uint32 frameCount, float frameRate) :
+		m_nodeCount(nodeCount),
+		m_stride((nodeCount + 3) & ~3),
+		m_frameCount(std::max<uint32>(frameCount, 1)),
+		m_frameRate(frameRate),
+		m_parents(nodeCount, -1),
+		m_names(nodeCount)
+	{
+		//identity everywhere, the padding lanes included
+		m_samples.resize(m_frameCount * CHANNEL_COUNT * m_stride, 0.0f);
+		for (uint32 f = 0; f < m_frameCount; f++)
+		{
+			std::fill_n(Channel(f, CHANNEL_QW), m_stride, 1.0f);
+			std::fill_n(Channel(f, CHANNEL_SX), m_stride * 3, 1.0f);
+		}
+	}
+
+	void AnimationClip::SetNode(uint32 node, const std::string& name, int parent)
+	{
+		m_names[node] = name;
+		m_parents[node] = parent < (int)node ? parent : -1;
+	}
+
+	void AnimationClip::SetKey(uint32 frame, uint32 node, const vec3& t, const vec4& q, const vec3& s)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			Channel(frame, CHANNEL_TX + i)[node] = t[i];
+			Channel(frame, CHANNEL_SX + i)[node] = s[i];
+		}
+		for (int i = 0; i < 4; i++)
+			Channel(frame, CHANNEL_QX + i)[node] = q[i];
+	}
+
+	void AnimationClip::FinishBake()
+	{
+		for (uint32 f = 1; f < m_frameCount; f++)
+		{
+			for (uint32 n = 0; n < m_nodeCount; n++)
+			{
+				float dot = 0.0f;
+				for (int i = 0; i < 4; i++)
+					dot += Channel(f, CHANNEL_QX + i)[n] * Channel(f - 1, CHANNEL_QX + i)[n];
+				if (dot < 0.0f)
+				{
+					for (int i = 0; i < 4; i++)
+						Channel(f, CHANNEL_QX + i)[n] = -Channel(f, CHANNEL_QX + i)[n];
+				}
+			}
+		}
+	}
+
+	int AnimationClip::FindNode(const char* name) const
+	{
+		for (uint32 n = 0; n < m_nodeCount; n++)
+		{
+			if (m_names[n] == name)
+				return n;
+		}
+		return -1;
+	}
+
+	void AnimationClip::EvaluateLocal(double time, mat4* out) const
+	{
+		if (m_nodeCount == 0)
+			return;
+
+		uint32 f0 = 0;
+		uint32 f1 = 0;
+		float frac = 0.0f;
+		if (m_frameCount > 1)
+		{
+			double duration = GetDuration();
+			double t = fmod(time, duration);
+			if (t < 0.0)
+				t += duration;
+			double frame = t * m_frameRate;
+			f0 = std::min<uint32>((uint32)frame, m_frameCount - 2);
+			f1 = f0 + 1;
+			frac = std::min<float>((float)(frame - f0), 1.0f);
+		}
+
+		__m128 w0 = _mm_set1_ps(1.0f - frac);
+		__m128 w1 = _mm_set1_ps(frac);
+		__m128 one = _mm_set1_ps(1.0f);
+		__m128 two = _mm_set1_ps(2.0f);
+		__m128 zero = _mm_setzero_ps();
+
+		//four nodes per iteration, every channel is a lane per node
+		for (uint32 n = 0; n < m_stride; n += 4)
+		{
+			__m128 c[CHANNEL_COUNT];
+			for (int i = 0; i < CHANNEL_COUNT; i++)
+				c[i] = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(Channel(f0, i) + n), w0), _mm_mul_ps(_mm_loadu_ps(Channel(f1, i) + n), w1));
+
+			//nlerp, the bake keeps neighbouring keys on one hemisphere
+			__m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[CHANNEL_QX], c[CHANNEL_QX]), _mm_mul_ps(c[CHANNEL_QY], c[CHANNEL_QY])),
+				_mm_add_ps(_mm_mul_ps(c[CHANNEL_QZ], c[CHANNEL_QZ]), _mm_mul_ps(c[CHANNEL_QW], c[CHANNEL_QW])));
+			//2/|q|^2 folds the normalization into the usual factor of two
+			__m128 k = _mm_div_ps(two, len2);
+			__m128 x = c[CHANNEL_QX], y = c[CHANNEL_QY], z = c[CHANNEL_QZ], w = c[CHANNEL_QW];
+			__m128 xx = _mm_mul_ps(_mm_mul_ps(x, x), k), yy = _mm_mul_ps(_mm_mul_ps(y, y), k), zz = _mm_mul_ps(_mm_mul_ps(z, z), k);
+			__m128 xy = _mm_mul_ps(_mm_mul_ps(x, y), k), xz = _mm_mul_ps(_mm_mul_ps(x, z), k), yz = _mm_mul_ps(_mm_mul_ps(y, z), k);
+			__m128 wx = _mm_mul_ps(_mm_mul_ps(w, x), k), wy = _mm_mul_ps(_mm_mul_ps(w, y), k), wz = _mm_mul_ps(_mm_mul_ps(w, z), k);
+
+			//columns of T * R * S, transposed from lanes per node into one column per node
+			__m128 col0[4] = {
+				_mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), c[CHANNEL_SX]),
+				_mm_mul_ps(_mm_add_ps(xy, wz), c[CHANNEL_SX]),
+				_mm_mul_ps(_mm_sub_ps(xz, wy), c[CHANNEL_SX]),
+				zero };
+			__m128 col1[4] = {
+				_mm_mul_ps(_mm_sub_ps(xy, wz), c[CHANNEL_SY]),
+				_mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), c[CHANNEL_SY]),
+				_mm_mul_ps(_mm_add_ps(yz, wx), c[CHANNEL_SY]),
+				zero };
+			__m128 col2[4] = {
+				_mm_mul_ps(_mm_add_ps(xz, wy), c[CHANNEL_SZ]),
+				_mm_mul_ps(_mm_sub_ps(yz, wx), c[CHANNEL_SZ]),
+				_mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), c[CHANNEL_SZ]),
+				zero };
+			__m128 col3[4] = { c[CHANNEL_TX], c[CHANNEL_TY], c[CHANNEL_TZ], one };
+			_MM_TRANSPOSE4_PS(col0[0], col0[1], col0[2], col0[3]);
+			_MM_TRANSPOSE4_PS(col1[0], col1[1], col1[2], col1[3]);
+			_MM_TRANSPOSE4_PS(col2[0], col2[1], col2[2], col2[3]);
+			_MM_TRANSPOSE4_PS(col3[0], col3[1], col3[2], col3[3]);
+
+			uint32 lanes = std::min<uint32>(4, m_nodeCount - n);
+			for (uint32 l = 0; l < lanes; l++)
+			{
+				float* m = &out[n + l][0][0];
+				_mm_storeu_ps(m, col0[l]);
+				_mm_storeu_ps(m + 4, col1[l]);
+				_mm_storeu_ps(m + 8, col2[l]);
+				_mm_storeu_ps(m + 12, col3[l]);
+			}
+		}
+	}
+
+	void AnimationClip::EvaluateGlobal(double time, mat4* out) const
+	{
+		EvaluateLocal(time, out);
+		for (uint32 n = 0; n < m_nodeCount; n++)
+		{
+			if (m_parents[n] >= 0)
+				out[n] = out[m_parents[n]] * out[n];
+		}
+	}
+
+}
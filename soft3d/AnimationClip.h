@@ -0,0 +1,62 @@
+#pragma once
+#include "soft3d.h"
+#include <boost/noncopyable.hpp>
+#include <string>
+#include <vector>
+
+namespace soft3d
+{
+
+	//local TRS of every node of a scene sampled at a fixed rate, rotation kept as a quaternion;
+	//immutable once baked so any number of threads can evaluate it without locking
+	class AnimationClip : public boost::noncopyable
+	{
+	public:
+		AnimationClip(uint32 nodeCount, uint32 frameCount, float frameRate);
+
+		//parents have to come before their children, -1 for a root
+		void SetNode(uint32 node, const std::string& name, int parent);
+		//rotation is a quaternion stored as xyzw
+		void SetKey(uint32 frame, uint32 node, const vmath::vec3& t, const vmath::vec4& q, const vmath::vec3& s);
+		//flips quaternions onto the hemisphere of the previous frame so evaluation can nlerp without a sign test
+		void FinishBake();
+
+		inline uint32 GetNodeCount() const { return m_nodeCount; }
+		inline uint32 GetFrameCount() const { return m_frameCount; }
+		inline float GetDuration() const { return (m_frameCount - 1) / m_frameRate; }
+		inline int GetParent(uint32 node) const { return m_parents[node]; }
+		inline const std::string& GetNodeName(uint32 node) const { return m_names[node]; }
+		int FindNode(const char* name) const;
+
+		//local matrix of every node at time, time wraps around the clip; out receives GetNodeCount matrices
+		void EvaluateLocal(double time, vmath::mat4* out) const;
+		//same with the parent chain applied
+		void EvaluateGlobal(double time, vmath::mat4* out) const;
+
+	private:
+		enum CHANNEL
+		{
+			CHANNEL_TX, CHANNEL_TY, CHANNEL_TZ,
+			CHANNEL_QX, CHANNEL_QY, CHANNEL_QZ, CHANNEL_QW,
+			CHANNEL_SX, CHANNEL_SY, CHANNEL_SZ,
+			CHANNEL_COUNT,
+		};
+
+		//one channel of all nodes for a frame, nodes padded to a multiple of four for SSE
+		inline float* Channel(uint32 frame, uint32 channel) {
+			return &m_samples[(frame * CHANNEL_COUNT + channel) * m_stride];
+		}
+		inline const float* Channel(uint32 frame, uint32 channel) const {
+			return &m_samples[(frame * CHANNEL_COUNT + channel) * m_stride];
+		}
+
+		uint32 m_nodeCount;
+		uint32 m_stride;
+		uint32 m_frameCount;
+		float m_frameRate;
+		std::vector<float> m_samples;
+		std::vector<int> m_parents;
+		std::vector<std::string> m_names;
+	};
+
+}
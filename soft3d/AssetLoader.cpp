@@ -0,0 +1,258 @@
+#include "soft3d.h"
+#include "AssetLoader.h"
+#include "TextureLoader.h"
+#include "FbxLoader.h"
+#include "GlbLoader.h"
+#include "ThreadPool.h"
+#include <boost/bind.hpp>
+#include <algorithm>
+
+using namespace std;
+using namespace vmath;
+
+namespace soft3d
+{
+
+	//inverse of a node transform, which is affine: the 3x3 part through its cofactors, then the translation
+	static mat4 InverseAffine(const mat4& m)
+	{
+		float cof[3][3];
+		for (int c = 0; c < 3; c++)
+		{
+			for (int r = 0; r < 3; r++)
+			{
+				int c1 = (c + 1) % 3, c2 = (c + 2) % 3, r1 = (r + 1) % 3, r2 = (r + 2) % 3;
+				cof[c][r] = m[c1][r1] * m[c2][r2] - m[c1][r2] * m[c2][r1];
+			}
+		}
+		float det = m[0][0] * cof[0][0] + m[0][1] * cof[0][1] + m[0][2] * cof[0][2];
+		float invDet = det != 0.0f ? 1.0f / det : 0.0f;
+		mat4 inv = mat4::identity();
+		for (int c = 0; c < 3; c++)
+		{
+			for (int r = 0; r < 3; r++)
+				inv[c][r] = cof[r][c] * invDet;
+		}
+		for (int r = 0; r < 3; r++)
+			inv[3][r] = -(inv[0][r] * m[3][0] + inv[1][r] * m[3][1] + inv[2][r] * m[3][2]);
+		return inv;
+	}
+
+	//bakes every mesh into one set of buffers in the space of the first mesh, which is the space a single mesh
+	//file is drawn in, so scenes keep their camera and the other meshes land where their nodes put them;
+	//geometry only, the meshes share whatever texture the scene binds
+	static void MergeMeshes(const vector<MeshCache::Mesh>& meshes, VertexBufferObject* vbo)
+	{
+		bool hasUV = false;
+		uint32 vertexCount = 0;
+		uint32 indexCount = 0;
+		for (size_t m = 0; m < meshes.size(); m++)
+		{
+			hasUV = hasUV || meshes[m].uvs != nullptr;
+			vertexCount += meshes[m].vertexCount;
+			indexCount += meshes[m].indexCount;
+		}
+		vector<float> vertices;
+		vector<uint32> indices;
+		vector<float> normals(vertexCount * 3, 0.0f);
+		vector<float> uvs(hasUV ? vertexCount * 2 : 0, 0.0f);
+		vertices.reserve(vertexCount * 4);
+		indices.reserve(indexCount);
+
+		mat4 toFirst = meshes.empty() ? mat4::identity() : InverseAffine(meshes[0].transform);
+		for (size_t m = 0; m < meshes.size(); m++)
+		{
+			const MeshCache::Mesh& mesh = meshes[m];
+			if (mesh.vertexCount == 0)
+				continue;
+			uint32 base = vertices.size() / 4;
+			mat4 rel = m == 0 ? mat4::identity() : toFirst * mesh.transform;
+			//normals go through the cofactors, flipped with the winding when the node mirrors
+			float nm[3][3];
+			for (int c = 0; c < 3; c++)
+			{
+				for (int r = 0; r < 3; r++)
+				{
+					int c1 = (c + 1) % 3, c2 = (c + 2) % 3, r1 = (r + 1) % 3, r2 = (r + 2) % 3;
+					nm[c][r] = rel[c1][r1] * rel[c2][r2] - rel[c1][r2] * rel[c2][r1];
+				}
+			}
+			bool mirrored = rel[0][0] * nm[0][0] + rel[0][1] * nm[0][1] + rel[0][2] * nm[0][2] < 0.0f;
+
+			for (uint32 i = 0; i < mesh.vertexCount; i++)
+			{
+				const float* p = mesh.vertices + i * 4;
+				for (int r = 0; r < 3; r++)
+					vertices.push_back(rel[0][r] * p[0] + rel[1][r] * p[1] + rel[2][r] * p[2] + rel[3][r]);
+				vertices.push_back(1.0f);
+			}
+			for (uint32 i = 0; mesh.normals != nullptr && i < std::min(mesh.normalCount, mesh.vertexCount); i++)
+			{
+				const float* n = mesh.normals + i * 3;
+				vec3 t;
+				for (int r = 0; r < 3; r++)
+					t[r] = nm[0][r] * n[0] + nm[1][r] * n[1] + nm[2][r] * n[2];
+				float len = length(t);
+				if (len > 0.0f)
+					t /= mirrored ? -len : len;
+				memcpy(&normals[(base + i) * 3], &t[0], 3 * sizeof(float));
+			}
+			if (mesh.uvs != nullptr)
+				memcpy(&uvs[base * 2], mesh.uvs, std::min(mesh.uvCount, mesh.vertexCount) * 2 * sizeof(float));
+
+			uint32 first = indices.size();
+			for (uint32 i = 0; mesh.indices != nullptr && i < mesh.indexCount; i++)
+				indices.push_back(base + std::min(mesh.indices[i], mesh.vertexCount - 1));
+			if (mirrored)
+			{
+				for (uint32 i = first; i + 2 < indices.size(); i += 3)
+					std::swap(indices[i + 1], indices[i + 2]);
+			}
+		}
+
+		vbo->MoveVertexBuffer(std::move(vertices));
+		vbo->MoveIndexBuffer(std::move(indices));
+		vbo->MoveNormalBuffer(std::move(normals));
+		if (hasUV)
+			vbo->MoveUVBuffer(std::move(uvs));
+	}
+
+	AssetLoader& AssetLoader::Instance()
+	{
+		static AssetLoader s_instance;
+		return s_instance;
+	}
+
+	AssetLoader::AssetLoader() :
+		m_pending(0)
+	{
+	}
+
+	shared_ptr<AssetHandle<Texture> > AssetLoader::LoadTextureAsync(const char* filename, const TEXTURE_LOADED_CB& cb,
+		Texture::LAYOUT layout, Texture::FORMAT format)
+	{
+		shared_ptr<AssetHandle<Texture> > handle(new AssetHandle<Texture>());
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			m_pending++;
+		}
+		//create the singleton here, lazy creation on two workers at once would race
+		TextureLoader::Instance();
+		ThreadPool::Instance().Post(boost::bind(&AssetLoader::LoadTextureTask, this, string(filename), layout, format, handle, cb));
+		return handle;
+	}
+
+	shared_ptr<AssetHandle<VertexBufferObject> > AssetLoader::LoadMeshAsync(const char* filename, const MESH_LOADED_CB& cb)
+	{
+		shared_ptr<AssetHandle<VertexBufferObject> > handle(new AssetHandle<VertexBufferObject>());
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			m_pending++;
+		}
+		ThreadPool::Instance().Post(boost::bind(&AssetLoader::LoadMeshTask, this, string(filename), handle, cb));
+		return handle;
+	}
+
+	void AssetLoader::LoadTextureTask(string filename, Texture::LAYOUT layout, Texture::FORMAT format,
+		shared_ptr<AssetHandle<Texture> > handle, TEXTURE_LOADED_CB cb)
+	{
+		shared_ptr<Texture> tex = TextureLoader::Instance().LoadTexture(filename.c_str(), layout, format);
+		if (tex == nullptr)
+			printf("Failed to load texture %s.\n", filename.c_str());
+		handle->Finish(tex);
+		Complete(cb ? boost::function<void()>(boost::bind(cb, tex)) : boost::function<void()>());
+	}
+
+	void AssetLoader::LoadMeshTask(string filename, shared_ptr<AssetHandle<VertexBufferObject> > handle,
+		MESH_LOADED_CB cb)
+	{
+		shared_ptr<VertexBufferObject> vbo = AssetLoader::LoadMesh(filename.c_str());
+		if (vbo == nullptr)
+			printf("Failed to load mesh %s.\n", filename.c_str());
+		handle->Finish(vbo);
+		Complete(cb ? boost::function<void()>(boost::bind(cb, vbo)) : boost::function<void()>());
+	}
+
+	shared_ptr<VertexBufferObject> AssetLoader::LoadMesh(const char* filename)
+	{
+		shared_ptr<VertexBufferObject> vbo(new VertexBufferObject());
+		string ext(filename);
+		ext = ext.substr(ext.find_last_of('.') + 1);
+		for (size_t i = 0; i < ext.size(); i++)
+			ext[i] = (char)tolower(ext[i]);
+		if (ext == "glb")
+		{
+			GlbLoader glb;
+			if (glb.LoadGlb(filename) != 0)
+				return nullptr;
+			vbo->CopyVertexBuffer(glb.GetVertexBuffer(), glb.GetVertexCount() * 4);
+			vbo->CopyIndexBuffer(glb.GetIndexBuffer(), glb.GetIndexCount());
+			vbo->CopyNormalBuffer(glb.GetNormalBuffer(), glb.GetNormalCount() * 3);
+			if (glb.GetUVBuffer() != nullptr)
+				vbo->CopyUVBuffer(glb.GetUVBuffer(), glb.GetUVCount() * 2);
+		}
+		else
+		{
+			//a single mesh is viewed straight from the mapping, several are merged into one copy
+			FbxLoader fbx;
+			shared_ptr<MeshCache> cache = fbx.LoadMeshCache(filename);
+			if (cache && cache->GetMeshCount() == 1)
+				vbo->AdoptMeshCache(cache);
+			else if (cache && cache->GetMeshCount() > 1)
+				MergeMeshes(cache->GetMeshes(), vbo.get());
+			else if (!fbx.GetMeshes().empty())
+			{
+				vector<MeshCache::Mesh> meshes;
+				fbx.GetMeshViews(meshes);
+				MergeMeshes(meshes, vbo.get());
+			}
+			else
+				return nullptr;
+		}
+		vbo->m_attributeLayout = VertexBufferObject::ATTRIBUTES_PER_VERTEX;
+		return vbo;
+	}
+
+	void AssetLoader::Complete(const boost::function<void()>& cb)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_completed.push_back(cb);
+	}
+
+	void AssetLoader::Dispatch()
+	{
+		std::vector<boost::function<void()> > completed;
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			completed.swap(m_completed);
+			m_pending -= completed.size();
+		}
+		for (size_t i = 0; i < completed.size(); i++)
+		{
+			if (completed[i])
+				completed[i]();
+		}
+	}
+
+	uint32 AssetLoader::GetPendingCount() const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		return m_pending;
+	}
+
+	shared_ptr<Texture> AssetLoader::GetPlaceholderTexture()
+	{
+		if (!m_placeholder)
+		{
+			uint32 tex_data[] = {
+				0xff808080, 0xffa0a0a0,
+				0xffa0a0a0, 0xff808080,
+			};
+			m_placeholder = shared_ptr<Texture>(new Texture());
+			m_placeholder->CopyFromBuffer(tex_data, 2, 2);
+			m_placeholder->filter_mode = Texture::NEAREST;
+		}
+		return m_placeholder;
+	}
+
+}
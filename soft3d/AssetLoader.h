@@ -0,0 +1,94 @@
+#pragma once
+#include "soft3d.h"
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include <string>
+#include <vector>
+
+namespace soft3d
+{
+
+	//result of an asynchronous load, ready once the worker is done with it
+	template <typename T>
+	class AssetHandle : public boost::noncopyable
+	{
+	public:
+		AssetHandle() : m_done(false) {}
+
+		bool IsDone() const {
+			boost::mutex::scoped_lock lock(m_mutex);
+			return m_done;
+		}
+		//nullptr while loading and when the load failed
+		std::shared_ptr<T> Get() const {
+			boost::mutex::scoped_lock lock(m_mutex);
+			return m_asset;
+		}
+		//blocks until the worker finished, the completion callback may still be pending
+		std::shared_ptr<T> Wait() const {
+			boost::mutex::scoped_lock lock(m_mutex);
+			while (!m_done)
+				m_cond.wait(lock);
+			return m_asset;
+		}
+
+	private:
+		friend class AssetLoader;
+		void Finish(const std::shared_ptr<T>& asset) {
+			{
+				boost::mutex::scoped_lock lock(m_mutex);
+				m_asset = asset;
+				m_done = true;
+			}
+			m_cond.notify_all();
+		}
+
+		mutable boost::mutex m_mutex;
+		mutable boost::condition_variable m_cond;
+		std::shared_ptr<T> m_asset;
+		bool m_done;
+	};
+
+	typedef boost::function<void(std::shared_ptr<Texture>)> TEXTURE_LOADED_CB;
+	typedef boost::function<void(std::shared_ptr<VertexBufferObject>)> MESH_LOADED_CB;
+
+	//decodes textures and meshes on the ThreadPool; completion callbacks are queued and run by
+	//Dispatch on the render thread at a frame boundary, where it is safe to touch the pipeline
+	class AssetLoader : public boost::noncopyable
+	{
+	public:
+		static AssetLoader& Instance();
+
+		std::shared_ptr<AssetHandle<Texture> > LoadTextureAsync(const char* filename, const TEXTURE_LOADED_CB& cb = TEXTURE_LOADED_CB(),
+			Texture::LAYOUT layout = Texture::LAYOUT_LINEAR, Texture::FORMAT format = Texture::FORMAT_BGRA8);
+		//.glb goes through GlbLoader, anything else through the fbx mesh cache
+		std::shared_ptr<AssetHandle<VertexBufferObject> > LoadMeshAsync(const char* filename, const MESH_LOADED_CB& cb = MESH_LOADED_CB());
+
+		//blocking version run on the workers, every mesh of the file ends up in the one vbo;
+		//the per mesh material and texture of an fbx are dropped there, the pipeline binds one texture
+		//per frame, so callers that need them load through FbxLoader and read FbxLoader::GetMeshes
+		static std::shared_ptr<VertexBufferObject> LoadMesh(const char* filename);
+
+		//runs the callbacks of every load finished since the last call, called once per frame
+		void Dispatch();
+		//loads queued or running
+		uint32 GetPendingCount() const;
+
+		//shown until the real texture arrives
+		std::shared_ptr<Texture> GetPlaceholderTexture();
+
+	private:
+		AssetLoader();
+		void LoadTextureTask(std::string filename, Texture::LAYOUT layout, Texture::FORMAT format,
+			std::shared_ptr<AssetHandle<Texture> > handle, TEXTURE_LOADED_CB cb);
+		void LoadMeshTask(std::string filename, std::shared_ptr<AssetHandle<VertexBufferObject> > handle, MESH_LOADED_CB cb);
+		void Complete(const boost::function<void()>& cb);
+
+		mutable boost::mutex m_mutex;
+		std::vector<boost::function<void()> > m_completed;
+		uint32 m_pending;
+		std::shared_ptr<Texture> m_placeholder;
+	};
+
+}
@@ -155,6 +155,7 @@ namespace soft3d {
 
 		m_d2dContext->BeginDraw();
 
+		boost::mutex::scoped_lock lock(m_profileMutex);
 		std::wstring content;
 		wchar_t buf[64];
 		DWORD nowTick = GetTickCount();
@@ -192,11 +193,13 @@ namespace soft3d {
 				swprintf(buf, L"%s:%0.1fms ", it->first.c_str(), it->second);
 				content += buf;
 			}
+			content += m_status;
 		}
 		D2D1_RECT_F rectf = { 0.0f, 0.0f, (float)width, 0.0f };
 
 		m_d2dContext->DrawTextW(content.c_str(), content.size(), m_pTextFormat, rectf, m_pGreenBrush);
 		m_profileInfo.clear();
+		lock.unlock();
 
 		ThrowIfFailed(m_d2dContext->EndDraw());
 
@@ -210,10 +213,17 @@ namespace soft3d {
 
 	void DirectXHelper::Profile(DWORD tick, const wchar_t* work)
 	{
+		boost::mutex::scoped_lock lock(m_profileMutex);
 		DWORD gap = tick - m_lastTick;
 		if(work[0] != 0)
 			m_profileInfo[work] += gap;
 		m_lastTick = tick;
 	}
 
+	void DirectXHelper::SetStatus(const wchar_t* status)
+	{
+		boost::mutex::scoped_lock lock(m_profileMutex);
+		m_status = status;
+	}
+
 }
\ No newline at end of file
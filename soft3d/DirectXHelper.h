@@ -11,6 +11,7 @@
 #pragma comment(lib, "d3d11.lib")
 #include <memory>
 #include <map>
+#include <boost/thread/mutex.hpp>
 
 namespace soft3d
 {
@@ -24,8 +25,11 @@ namespace soft3d
 		~DirectXHelper();
 
 		void Init(HWND hwnd);
+		//may run on the present thread while the render thread keeps calling Profile
 		void Paint(const uint32* buffer, uint16 width, uint16 height);
 		void Profile(DWORD tick, const wchar_t* work);
+		//shown after the profile, replaces the last one
+		void SetStatus(const wchar_t* status);
 
 	protected:
 		DirectXHelper();
@@ -62,6 +66,8 @@ namespace soft3d
 		std::map<std::wstring, DWORD> m_profileInfo;
 		DWORD m_lastTick = 0;
 		std::map<std::wstring, float> m_profileShow;
+		std::wstring m_status;
+		boost::mutex m_profileMutex;
 
 		static std::shared_ptr<DirectXHelper> s_instance;
 	};
@@ -1,21 +1,80 @@
-
 #pragma comment(lib, "libfbxsdk.lib")
 #include "FbxLoader.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "MeshWelder.h"
+#include <boost/bind.hpp>
 
 namespace soft3d
 {
 
+	static vmath::mat4 ToMat4(const FbxAMatrix& fmat)
+	{
+		vmath::mat4 mat;
+		for (int m = 0; m < 4; m++)
+			for (int n = 0; n < 4; n++)
+			{
+				mat[m][n] = (float)fmat.mData[m][n];
+			}
+		return mat;
+	}
+
 	FbxLoader::FbxLoader()
 	{
+		m_rootNode = nullptr;
+		m_fbxManager = nullptr;
 	}
 
 
 	FbxLoader::~FbxLoader()
 	{
-		delete[] m_indexBuffer;
-		delete[] m_vertexBuffer;
-		delete[] m_normalBuffer;
-		m_fbxManager->Destroy();
+		if (m_fbxManager != nullptr)
+			m_fbxManager->Destroy();
+	}
+
+	void FbxLoader::GetMeshViews(std::vector<MeshCache::Mesh>& views) const
+	{
+		views.resize(m_meshes.size());
+		for (size_t i = 0; i < m_meshes.size(); i++)
+		{
+			const FbxMeshData& mesh = m_meshes[i];
+			MeshCache::Mesh& view = views[i];
+			view.vertices = mesh.vertices.empty() ? nullptr : &mesh.vertices[0];
+			view.vertexCount = mesh.vertices.size() / 4;
+			view.indices = mesh.indices.empty() ? nullptr : &mesh.indices[0];
+			view.indexCount = mesh.indices.size();
+			view.normals = mesh.normals.empty() ? nullptr : &mesh.normals[0];
+			view.normalCount = mesh.normals.size() / 3;
+			view.uvs = mesh.uvs.empty() ? nullptr : &mesh.uvs[0];
+			view.uvCount = mesh.uvs.size() / 2;
+			view.transform = mesh.transform;
+			view.boundsMin = vmath::vec3(0.0f, 0.0f, 0.0f);
+			view.boundsMax = vmath::vec3(0.0f, 0.0f, 0.0f);
+		}
+	}
+
+	bool FbxLoader::SaveMeshCache(const char* filename, uint64 stamp) const
+	{
+		if (m_meshes.empty())
+			return false;
+		std::vector<MeshCache::Mesh> views;
+		GetMeshViews(views);
+		return MeshCache::Save(filename, stamp, views);
+	}
+
+	std::shared_ptr<MeshCache> FbxLoader::LoadMeshCache(const char* fbxName)
+	{
+		uint64 stamp = MappedFile::GetFileStamp(fbxName);
+		std::string cacheName = std::string(fbxName) + ".s3dmesh";
+		std::shared_ptr<MeshCache> mesh(new MeshCache());
+		if (stamp != 0 && mesh->Open(cacheName.c_str(), stamp))
+			return mesh;
+
+		if (LoadFbx(fbxName) != 0 || !SaveMeshCache(cacheName.c_str(), stamp) || !mesh->Open(cacheName.c_str(), stamp))
+			return nullptr;
+		//the mapping holds the geometry from now on, keeping the parsed copy would double the footprint
+		m_meshes.clear();
+		return mesh;
 	}
 
 
@@ -36,133 +95,274 @@ namespace soft3d
 		lImporter->Import(lScene);
 		lImporter->Destroy();
 
+		m_meshes.clear();
+		m_fbxMeshes.clear();
+		m_nodes.clear();
+		m_nodeParents.clear();
+		m_nodeIndices.clear();
 		m_rootNode = lScene->GetRootNode();
 		if (m_rootNode) {
-			m_firstNode = m_rootNode->GetChild(0);
 			for (int i = 0; i < m_rootNode->GetChildCount(); i++)
-				LoadNode(m_rootNode->GetChild(i));
+				LoadNode(m_rootNode->GetChild(i), -1);
 		}
-		m_animEvaluator = lScene->GetAnimationEvaluator();
+
+		//the sdk is not thread safe, so every call into it (control points, layers, skin clusters)
+		//stays on this thread; only the welding of the copied arrays is spread over the pool
+		m_cpBones.resize(m_fbxMeshes.size());
+		m_cpWeights.resize(m_fbxMeshes.size());
+		for (uint32 i = 0; i < m_fbxMeshes.size(); i++)
+			ReadMesh(i);
+		ThreadPool::Instance().ParallelFor((uint32)m_fbxMeshes.size(), boost::bind(&FbxLoader::WeldMesh, this, _1));
+		m_fbxMeshes.clear();
+		m_cpBones.clear();
+		m_cpWeights.clear();
+
+		BakeAnimation(lScene);
+		m_nodes.clear();
+		m_nodeParents.clear();
+		m_nodeIndices.clear();
 		return 0;
 	}
 
-	void FbxLoader::LoadNode(FbxNode* pNode)
+	void FbxLoader::LoadNode(FbxNode* pNode, int parent)
 	{
+		int index = m_nodes.size();
+		m_nodes.push_back(pNode);
+		m_nodeParents.push_back(parent);
+		m_nodeIndices[pNode] = index;
+
 		for (int i = 0; i < pNode->GetNodeAttributeCount(); i++)
-			LoadAttribute(pNode->GetNodeAttributeByIndex(i));
+			LoadAttribute(pNode, pNode->GetNodeAttributeByIndex(i));
 
 		// Recursively print the children.
 		for (int j = 0; j < pNode->GetChildCount(); j++)
-			LoadNode(pNode->GetChild(j));
+			LoadNode(pNode->GetChild(j), index);
 	}
 
-	void FbxLoader::LoadAttribute(FbxNodeAttribute* pAttribute)
+	void FbxLoader::BakeAnimation(FbxScene* scene)
 	{
-		if (pAttribute->GetAttributeType() == FbxNodeAttribute::eMesh)
+		//the evaluator is only queried here, playback samples the baked tracks
+		FbxAnimStack* stack = scene->GetCurrentAnimationStack();
+		FbxTime start;
+		uint32 frameCount = 1;
+		if (stack != nullptr)
 		{
-			FbxMesh* pMesh = (FbxMesh*)pAttribute;
+			FbxTimeSpan span = stack->GetLocalTimeSpan();
+			start = span.GetStart();
+			frameCount = (uint32)(span.GetDuration().GetSecondDouble() * animationSampleRate + 0.5) + 1;
+		}
 
-			FbxVector4* IControlPoints = pMesh->GetControlPoints();
-			m_vertexCount = pMesh->GetControlPointsCount();
-			m_vertexBuffer = new float[m_vertexCount * 4];
-			for (int i = 0; i < m_vertexCount * 4; i+=4)
+		m_animation.reset(new AnimationClip(m_nodes.size(), frameCount, animationSampleRate));
+		for (uint32 n = 0; n < m_nodes.size(); n++)
+			m_animation->SetNode(n, m_nodes[n]->GetName(), m_nodeParents[n]);
+
+		FbxAnimEvaluator* evaluator = scene->GetAnimationEvaluator();
+		for (uint32 f = 0; f < frameCount; f++)
+		{
+			FbxTime ftime;
+			ftime.SetSecondDouble(start.GetSecondDouble() + f / animationSampleRate);
+			for (uint32 n = 0; n < m_nodes.size(); n++)
 			{
-				m_vertexBuffer[i]     = (float)IControlPoints[i / 4].mData[0];
-				m_vertexBuffer[i + 1] = (float)IControlPoints[i / 4].mData[1];
-				m_vertexBuffer[i + 2] = (float)IControlPoints[i / 4].mData[2];
-				m_vertexBuffer[i + 3] = 1.0f;// IControlPoints[i / 4].mData[3];
+				FbxAMatrix& fmat = evaluator->GetNodeLocalTransform(m_nodes[n], ftime);
+				FbxVector4 t = fmat.GetT();
+				FbxQuaternion q = fmat.GetQ();
+				FbxVector4 s = fmat.GetS();
+				m_animation->SetKey(f, n,
+					vmath::vec3((float)t[0], (float)t[1], (float)t[2]),
+					vmath::vec4((float)q[0], (float)q[1], (float)q[2], (float)q[3]),
+					vmath::vec3((float)s[0], (float)s[1], (float)s[2]));
 			}
+		}
+		m_animation->FinishBake();
+	}
 
-			int* pIndices = pMesh->GetPolygonVertices();
-			m_indexCount = pMesh->GetPolygonVertexCount();
-			m_indexBuffer = new uint32[m_indexCount];
-			for (int i = 0; i < m_indexCount; ++i)
+	void FbxLoader::LoadAttribute(FbxNode* pNode, FbxNodeAttribute* pAttribute)
+	{
+		if (pAttribute->GetAttributeType() == FbxNodeAttribute::eMesh)
+		{
+			m_meshes.push_back(FbxMeshData());
+			m_fbxMeshes.push_back((FbxMesh*)pAttribute);
+			FbxMeshData& mesh = m_meshes.back();
+
+			mesh.name = pNode->GetName();
+			mesh.node = m_nodes.size() - 1;
+			mesh.transform = ToMat4(pNode->EvaluateGlobalTransform());
+
+			if (pNode->GetMaterialCount() > 0)
 			{
-				m_indexBuffer[i] = pIndices[i];
+				FbxSurfaceMaterial* pMaterial = pNode->GetMaterial(0);
+				mesh.material = pMaterial->GetName();
+				FbxProperty diffuse = pMaterial->FindProperty(FbxSurfaceMaterial::sDiffuse);
+				FbxFileTexture* pTexture = diffuse.GetSrcObject<FbxFileTexture>(0);
+				if (pTexture != NULL)
+					mesh.texture = pTexture->GetRelativeFileName();
 			}
+		}
+	}
 
-			FbxLayer* pLayer = pMesh->GetLayer(0);
-			if (pLayer != NULL)
-			{
-				FbxLayerElementNormal* pNormal = pLayer->GetNormals();
-				m_normalCount = pNormal->mDirectArray->GetCount();
-				m_normalBuffer = new float[m_normalCount * 3];
-				for (int i = 0; i < m_normalCount * 3; i+=3)
-				{
-					m_normalBuffer[i]     = (float)(*pNormal->mDirectArray)[i / 3][0];
-					m_normalBuffer[i + 1] = (float)(*pNormal->mDirectArray)[i / 3][1];
-					m_normalBuffer[i + 2] = (float)(*pNormal->mDirectArray)[i / 3][2];
-					//m_normalBuffer[i + 3] = (*pNormal->mDirectArray)[i / 4][3];
-				}
+	//expands a layer element to one value per polygon vertex whatever its mapping,
+	//polygons are expected to be triangles like everywhere else in the loader
+	template <class T>
+	static void ReadLayerPerIndex(FbxLayerElementTemplate<T>* pElement, const int* pIndices, int indexCount, int components, std::vector<float>& out)
+	{
+		FbxLayerElement::EMappingMode mapping = pElement->GetMappingMode();
+		bool indexed = pElement->GetReferenceMode() != FbxLayerElement::eDirect;
+		int directCount = pElement->GetDirectArray().GetCount();
+		int indexArrayCount = indexed ? pElement->GetIndexArray().GetCount() : 0;
 
-				FbxLayerElementUV* pUV = pLayer->GetUVs();
-				if (pUV->GetMappingMode() == FbxLayerElement::eByPolygonVertex)
-				{
-					if (pUV->GetReferenceMode() == FbxLayerElement::eIndexToDirect)
-					{
-						m_uvCount = pUV->mIndexArray->GetCount();
-						m_uvBuffer = new float[m_uvCount * 2];
-						for (int i = 0; i < m_uvCount * 2; i+=2)
-						{
-							m_uvBuffer[i] = (float)(*pUV->mDirectArray)[(*pUV->mIndexArray)[i / 2]][0];
-							m_uvBuffer[i + 1] = (float)(*pUV->mDirectArray)[(*pUV->mIndexArray)[i / 2]][1];
-						}
-					}
-					else
-					{
-						m_uvCount = pUV->mDirectArray->GetCount();
-						m_uvBuffer = new float[m_uvCount * 2];
-						for (int i = 0; i < m_uvCount * 2; i += 2)
-						{
-							m_uvBuffer[i] = (float)(*pUV->mDirectArray)[i / 2][0];
-							m_uvBuffer[i + 1] = (float)(*pUV->mDirectArray)[i / 2][1];
-						}
-					}
-				}
-				else
-				{
-					if (pUV->GetReferenceMode() == FbxLayerElement::eIndexToDirect)
-					{
-						m_uvCount = pUV->mIndexArray->GetCount();
-						m_uvBuffer = new float[m_uvCount * 2];
-						for (int i = 0; i < m_uvCount * 2; i+=2)
-						{
-							m_uvBuffer[i] = (float)(*pUV->mDirectArray)[(*pUV->mIndexArray)[i / 2]][0];
-							m_uvBuffer[i + 1] = (float)(*pUV->mDirectArray)[(*pUV->mIndexArray)[i / 2]][1];
-						}
-					}
-					else
-					{
-						m_uvCount = pUV->mDirectArray->GetCount();
-						m_uvBuffer = new float[m_uvCount * 2];
-						for (int i = 0; i < m_uvCount * 2; i+=2)
-						{
-							m_uvBuffer[i] = (float)(*pUV->mDirectArray)[i / 2][0];
-							m_uvBuffer[i + 1] = (float)(*pUV->mDirectArray)[i / 2][1];
-						}
-					}
-				}
-			}
+		out.resize(indexCount * components);
+		for (int i = 0; i < indexCount; i++)
+		{
+			int element;
+			if (mapping == FbxLayerElement::eByControlPoint)
+				element = pIndices[i];
+			else if (mapping == FbxLayerElement::eByPolygon)
+				element = i / 3;
+			else if (mapping == FbxLayerElement::eAllSame)
+				element = 0;
+			else
+				element = i;
+			if (indexed)
+				element = element < indexArrayCount ? pElement->GetIndexArray()[element] : -1;
+			if (element < 0 || element >= directCount)
+				continue;
+			const T& value = pElement->GetDirectArray()[element];
+			for (int c = 0; c < components; c++)
+				out[i * components + c] = (float)value[c];
 		}
 	}
 
-	FbxAMatrix& FbxLoader::GetRootMatrixGlobalAtTime(double time)
+	void FbxLoader::ReadMesh(uint32 index)
 	{
-		FbxTime ftime;
-		ftime.SetSecondDouble(time);
-		ftime = m_animEvaluator->ValidateTime(ftime);
-		return m_animEvaluator->GetNodeGlobalTransform(m_firstNode, ftime);
+		FbxMesh* pMesh = m_fbxMeshes[index];
+		FbxMeshData& mesh = m_meshes[index];
+
+		FbxVector4* IControlPoints = pMesh->GetControlPoints();
+		int vertexCount = pMesh->GetControlPointsCount();
+		mesh.vertices.resize(vertexCount * 4);
+		for (int i = 0; i < vertexCount * 4; i += 4)
+		{
+			mesh.vertices[i]     = (float)IControlPoints[i / 4].mData[0];
+			mesh.vertices[i + 1] = (float)IControlPoints[i / 4].mData[1];
+			mesh.vertices[i + 2] = (float)IControlPoints[i / 4].mData[2];
+			mesh.vertices[i + 3] = 1.0f;// IControlPoints[i / 4].mData[3];
+		}
+
+		int* pIndices = pMesh->GetPolygonVertices();
+		int indexCount = pMesh->GetPolygonVertexCount();
+		mesh.indices.assign(pIndices, pIndices + indexCount);
+
+		FbxLayer* pLayer = pMesh->GetLayer(0);
+		if (pLayer != NULL)
+		{
+			if (pLayer->GetNormals() != NULL)
+				ReadLayerPerIndex(pLayer->GetNormals(), pIndices, indexCount, 3, mesh.normals);
+			if (pLayer->GetUVs() != NULL)
+				ReadLayerPerIndex(pLayer->GetUVs(), pIndices, indexCount, 2, mesh.uvs);
+		}
+
+		ExtractSkin(pMesh, mesh, m_cpBones[index], m_cpWeights[index]);
 	}
 
-	FbxAMatrix& FbxLoader::GetRootMatrixLocalAtTime(double time)
+	void FbxLoader::WeldMesh(uint32 index)
 	{
-		FbxTime ftime;
-		ftime.SetSecondDouble(time);
-		ftime = m_animEvaluator->ValidateTime(ftime);
-		int total = ftime.GetSecondDouble() * 1000;
-		int real = (int)(time * 1000) % total;
-		ftime.SetSecondDouble(real / 1000.0);
-		return m_animEvaluator->GetNodeLocalTransform(m_firstNode, ftime);
+		FbxMeshData& mesh = m_meshes[index];
+		const std::vector<uint16>& cpBones = m_cpBones[index];
+		const std::vector<float>& cpWeights = m_cpWeights[index];
+		if (mesh.boneNodes.empty())
+		{
+			//share identical corners between triangles, attributes end up per vertex
+			MeshWelder::Weld(mesh.vertices, mesh.indices, mesh.normals, mesh.uvs);
+			return;
+		}
+
+		//skin weights belong to control points, carry them over to the welded vertices
+		std::vector<uint32> sources;
+		MeshWelder::Weld(mesh.vertices, mesh.indices, mesh.normals, mesh.uvs, &sources);
+		mesh.boneIndices.resize(sources.size() * SkinnedMesh::MAX_INFLUENCES);
+		mesh.boneWeights.resize(sources.size() * SkinnedMesh::MAX_INFLUENCES);
+		for (uint32 i = 0; i < sources.size(); i++)
+		{
+			memcpy(&mesh.boneIndices[i * SkinnedMesh::MAX_INFLUENCES], &cpBones[sources[i] * SkinnedMesh::MAX_INFLUENCES], SkinnedMesh::MAX_INFLUENCES * sizeof(uint16));
+			memcpy(&mesh.boneWeights[i * SkinnedMesh::MAX_INFLUENCES], &cpWeights[sources[i] * SkinnedMesh::MAX_INFLUENCES], SkinnedMesh::MAX_INFLUENCES * sizeof(float));
+		}
+	}
+
+	//reads the clusters of the first skin deformer into MAX_INFLUENCES bones and weights per control point,
+	//keeping the heaviest influences and renormalizing them; control points no cluster weighs are bound
+	//rigidly to the mesh node through an extra bone, a zero weight sum would collapse them to the origin
+	void FbxLoader::ExtractSkin(FbxMesh* pMesh, FbxMeshData& mesh, std::vector<uint16>& cpBones, std::vector<float>& cpWeights) const
+	{
+		if (pMesh->GetDeformerCount(FbxDeformer::eSkin) == 0)
+			return;
+		FbxSkin* pSkin = (FbxSkin*)pMesh->GetDeformer(0, FbxDeformer::eSkin);
+		int cpCount = pMesh->GetControlPointsCount();
+		cpBones.assign(cpCount * SkinnedMesh::MAX_INFLUENCES, 0);
+		cpWeights.assign(cpCount * SkinnedMesh::MAX_INFLUENCES, 0.0f);
+
+		for (int c = 0; c < pSkin->GetClusterCount(); c++)
+		{
+			FbxCluster* pCluster = pSkin->GetCluster(c);
+			FbxNode* pLink = pCluster->GetLink();
+			if (pLink == NULL)
+				continue;
+			std::map<FbxNode*, int>::const_iterator it = m_nodeIndices.find(pLink);
+			uint16 bone = mesh.boneNodes.size();
+			mesh.boneNodes.push_back(it != m_nodeIndices.end() ? it->second : -1);
+
+			FbxAMatrix meshBind, boneBind;
+			pCluster->GetTransformMatrix(meshBind);
+			pCluster->GetTransformLinkMatrix(boneBind);
+			mesh.inverseBindPoses.push_back(ToMat4(boneBind.Inverse() * meshBind));
+
+			const int* pPoints = pCluster->GetControlPointIndices();
+			const double* pWeights = pCluster->GetControlPointWeights();
+			for (int i = 0; i < pCluster->GetControlPointIndicesCount(); i++)
+			{
+				int cp = pPoints[i];
+				float weight = (float)pWeights[i];
+				if (cp < 0 || cp >= cpCount || weight <= 0.0f)
+					continue;
+				//replace the lightest influence if this one is heavier
+				float* weights = &cpWeights[cp * SkinnedMesh::MAX_INFLUENCES];
+				int lightest = 0;
+				for (int k = 1; k < SkinnedMesh::MAX_INFLUENCES; k++)
+				{
+					if (weights[k] < weights[lightest])
+						lightest = k;
+				}
+				if (weight > weights[lightest])
+				{
+					weights[lightest] = weight;
+					cpBones[cp * SkinnedMesh::MAX_INFLUENCES + lightest] = bone;
+				}
+			}
+		}
+
+		if (mesh.boneNodes.empty())
+			return;
+		int rigidBone = -1;
+		for (int cp = 0; cp < cpCount; cp++)
+		{
+			float* weights = &cpWeights[cp * SkinnedMesh::MAX_INFLUENCES];
+			float sum = 0.0f;
+			for (int k = 0; k < SkinnedMesh::MAX_INFLUENCES; k++)
+				sum += weights[k];
+			if (sum > 0.0f)
+			{
+				for (int k = 0; k < SkinnedMesh::MAX_INFLUENCES; k++)
+					weights[k] /= sum;
+				continue;
+			}
+			if (rigidBone < 0)
+			{
+				rigidBone = mesh.boneNodes.size();
+				mesh.boneNodes.push_back(mesh.node);
+				mesh.inverseBindPoses.push_back(vmath::mat4::identity());
+			}
+			cpBones[cp * SkinnedMesh::MAX_INFLUENCES] = (uint16)rigidBone;
+			weights[0] = 1.0f;
+		}
 	}
 
 }
\ No newline at end of file
@@ -1,10 +1,38 @@
 #pragma once
 #include "soft3d.h"
 #include <fbxsdk.h>
+#include <string>
+#include <vector>
+#include <map>
+#include "MeshCache.h"
+#include "AnimationClip.h"
+#include "SkinnedMesh.h"
 
 namespace soft3d
 {
 
+	//one mesh node of an fbx scene, welded into xyzw positions with xyz normals and uv pairs
+	//per vertex, draw with VertexBufferObject::ATTRIBUTES_PER_VERTEX
+	struct FbxMeshData
+	{
+		std::string name;
+		int node;//index of the mesh node in the animation clip
+		vmath::mat4 transform;//node global transform at load time
+		std::string material;//name of the first material, empty if none
+		std::string texture;//file of that material's diffuse texture, empty if none
+
+		std::vector<float> vertices;
+		std::vector<uint32> indices;
+		std::vector<float> normals;
+		std::vector<float> uvs;
+
+		//skin, all empty when the mesh has no skin deformer
+		std::vector<uint16> boneIndices;//SkinnedMesh::MAX_INFLUENCES per vertex into boneNodes
+		std::vector<float> boneWeights;//as many, the weights of a vertex sum to one
+		std::vector<int> boneNodes;//animation clip node driving each bone
+		std::vector<vmath::mat4> inverseBindPoses;//mesh bind space into the space of each bone
+	};
+
 	class FbxLoader
 	{
 	public:
@@ -12,67 +40,85 @@ namespace soft3d
 		~FbxLoader();
 
 		int LoadFbx(const char* fbxName);
+		//writes every mesh with its transform as a MeshCache file
+		bool SaveMeshCache(const char* filename, uint64 stamp) const;
+		//maps <fbxName>.s3dmesh, parsing the fbx and writing the cache first when it is missing or stale;
+		//returns nullptr when no cache could be written, the parsed buffers are then still available
+		std::shared_ptr<MeshCache> LoadMeshCache(const char* fbxName);
+
+		const std::vector<FbxMeshData>& GetMeshes() const
+		{
+			return m_meshes;
+		}
+		//the parsed meshes in the layout of a mapped cache, pointing into GetMeshes
+		void GetMeshViews(std::vector<MeshCache::Mesh>& views) const;
 
+		//the buffer getters below refer to the first mesh, for single mesh files
 		const float* GetVertexBuffer() const
 		{
-			return m_vertexBuffer;
+			return m_meshes.empty() || m_meshes[0].vertices.empty() ? nullptr : &m_meshes[0].vertices[0];
 		}
 		uint32 GetVertexCount()
 		{
-			return m_vertexCount;
+			return m_meshes.empty() ? 0 : m_meshes[0].vertices.size() / 4;
 		}
 
 		const uint32* GetIndexBuffer() const
 		{
-			return m_indexBuffer;
+			return m_meshes.empty() || m_meshes[0].indices.empty() ? nullptr : &m_meshes[0].indices[0];
 		}
 		uint32 GetIndexCount()
 		{
-			return m_indexCount;
+			return m_meshes.empty() ? 0 : m_meshes[0].indices.size();
 		}
 
 		const float* GetNormalBuffer() const
 		{
-			return m_normalBuffer;
+			return m_meshes.empty() || m_meshes[0].normals.empty() ? nullptr : &m_meshes[0].normals[0];
 		}
 		uint32 GetNormalCount()
 		{
-			return m_normalCount;
+			return m_meshes.empty() ? 0 : m_meshes[0].normals.size() / 3;
 		}
 
 		const float* GetUVBuffer() const
 		{
-			return m_uvBuffer;
+			return m_meshes.empty() || m_meshes[0].uvs.empty() ? nullptr : &m_meshes[0].uvs[0];
 		}
 		uint32 GetUVCount()
 		{
-			return m_uvCount;
+			return m_meshes.empty() ? 0 : m_meshes[0].uvs.size() / 2;
 		}
 
-		FbxAMatrix& GetRootMatrixGlobalAtTime(double time);
-		FbxAMatrix& GetRootMatrixLocalAtTime(double time);
+		//every node of the scene baked at load time, node 0 is the first child of the root;
+		//a single frame of the bind pose when the file has no animation
+		std::shared_ptr<const AnimationClip> GetAnimation() const
+		{
+			return m_animation;
+		}
 
-	private:
-		void LoadNode(FbxNode* node);
-		void LoadAttribute(FbxNodeAttribute* pAttribute);
+		float animationSampleRate = 30.0f;//frames per second the animation is baked at
 
 	private:
-		float* m_vertexBuffer;
-		uint32 m_vertexCount;
+		void LoadNode(FbxNode* node, int parent);
+		void LoadAttribute(FbxNode* node, FbxNodeAttribute* pAttribute);
+		void ReadMesh(uint32 index);
+		void WeldMesh(uint32 index);
+		void ExtractSkin(FbxMesh* pMesh, FbxMeshData& mesh, std::vector<uint16>& cpBones, std::vector<float>& cpWeights) const;
+		void BakeAnimation(FbxScene* scene);
 
-		uint32* m_indexBuffer;
-		uint32 m_indexCount;
-
-		float* m_normalBuffer;
-		uint32 m_normalCount;
-
-		float* m_uvBuffer;
-		uint32 m_uvCount;
+	private:
+		std::vector<FbxMeshData> m_meshes;
+		std::vector<FbxMesh*> m_fbxMeshes;//source of each entry in m_meshes, only valid while loading
+		std::vector<std::vector<uint16> > m_cpBones;//skin of each mesh per control point, only valid while loading
+		std::vector<std::vector<float> > m_cpWeights;
+		std::vector<FbxNode*> m_nodes;//parents first, only valid while loading
+		std::vector<int> m_nodeParents;
+		std::map<FbxNode*, int> m_nodeIndices;
+		std::shared_ptr<AnimationClip> m_animation;
 
 		FbxNode* m_rootNode;
-		FbxNode* m_firstNode;
-		FbxAnimEvaluator* m_animEvaluator;
 		FbxManager* m_fbxManager;
 	};
 
-}
\ No newline at end of file
+}
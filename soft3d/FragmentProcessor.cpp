@@ -1,37 +1,80 @@
 #include "soft3d.h"
 #include "VertexProcessor.h"
 #include "FragmentProcessor.h"
+#include <xmmintrin.h>
 
 using namespace vmath;
 
 namespace soft3d
 {
 
+	//12 bit rsqrt estimate, plenty for 8 bit color
+	static inline vec3 FastNormalize(const vec3& v)
+	{
+		return v * _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(dot(v, v))));
+	}
+
 	void FragmentProcessor::Process()
 	{
 		if (fs_in.mode == VS_OUT::LIGHT_MODE)
 		{
-			fs_in.N = normalize(fs_in.N);
-			fs_in.L = normalize(fs_in.L);
-			//fs_in.V = normalize(fs_in.V);
-			fs_in.H = normalize(fs_in.H);
+			vec3 diffuse;
+			vec3 specular;
+			if (quality.lighting == QualityKnobs::LIGHTING_FULL)
+			{
+				fs_in.N = normalize(fs_in.N);
+				fs_in.L = normalize(fs_in.L);
+				//fs_in.V = normalize(fs_in.V);
+				fs_in.H = normalize(fs_in.H);
 
-			//vec3 R = reflect(fs_in.L, fs_in.N);
-			vec3 diffuse = vmath::max<float>(dot(fs_in.N, fs_in.L), 0.0f) * vec3(0.8f);
-			vec3 specular = pow(vmath::max<float>(dot(fs_in.H, fs_in.N), 0.0f), 128.0f) * vec3(0.8f);
-			vec3 finalcolor = diffuse + specular + vec3(0.1);
+				//vec3 R = reflect(fs_in.L, fs_in.N);
+				diffuse = vmath::max<float>(dot(fs_in.N, fs_in.L), 0.0f) * vec3(0.8f);
+				specular = pow(vmath::max<float>(dot(fs_in.H, fs_in.N), 0.0f), 128.0f) * vec3(0.8f);
+			}
+			else
+			{
+				fs_in.N = FastNormalize(fs_in.N);
+				fs_in.L = FastNormalize(fs_in.L);
+				diffuse = vmath::max<float>(dot(fs_in.N, fs_in.L), 0.0f) * vec3(0.8f);
+				specular = vec3(0.0f);
+				if (quality.lighting == QualityKnobs::LIGHTING_FAST)
+				{
+					fs_in.H = FastNormalize(fs_in.H);
+					//x^128 as seven squares
+					float s = std::min<float>(vmath::max<float>(dot(fs_in.H, fs_in.N), 0.0f), 1.0f);
+					for (int i = 0; i < 7; i++)
+						s *= s;
+					specular = s * vec3(0.8f);
+				}
+			}
+			//white unless an instanced draw tints it
+			vec3 tint;
+			uC2fC(fs_in.color, &tint);
+			vec3 finalcolor = (diffuse + specular + vec3(0.1)) * tint;
 			if (tex)
-				*out_color = tex->Sampler2D(&fs_in.uv) * (&finalcolor);
+				*out_color = Sample() * (&finalcolor);
 			else
 				*out_color = Color(0xffffff) * &finalcolor;
 		}
 		else
 		{
-			if (tex != nullptr)
-				*out_color = tex->Sampler2D(&fs_in.uv);
-			else
+			if (tex == nullptr)
 				*out_color = fs_in.color;
+			else if (fs_in.mode == VS_OUT::TINTED_TEXTURE_MODE)
+			{
+				vec3 tint;
+				uC2fC(fs_in.color, &tint);
+				*out_color = Sample() * (&tint);
+			}
+			else
+				*out_color = Sample();
 		}
 		//*out_color = fs_in.color;
 	}
+
+	Color FragmentProcessor::Sample() const
+	{
+		Texture::FILTER_MODE filter = quality.cheapFilter ? Texture::CheaperFilter(tex->filter_mode) : tex->filter_mode;
+		return tex->Sampler2D(&fs_in.uv, &fs_in.duvdx, &fs_in.duvdy, filter, quality.lodBias);
+	}
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #pragma once
+#include "QualityKnobs.h"
 
 namespace soft3d
 {
@@ -14,6 +15,10 @@ namespace soft3d
 		VS_OUT fs_in;
 		uint32* out_color = nullptr;
 		const Texture* tex = nullptr;
+		QualityKnobs quality;//lighting and sampling knobs, shadingShift is up to the rasterizer
+
+	private:
+		Color Sample() const;
 	};
 
 }
\ No newline at end of file
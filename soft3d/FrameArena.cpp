@@ -0,0 +1,58 @@
+#include "FrameArena.h"
+
+namespace soft3d
+{
+
+	FrameArena::FrameArena(size_t capacity) :
+		m_offset(0),
+		m_used(0)
+	{
+		Block block = { new char[capacity], capacity };
+		m_blocks.push_back(block);
+	}
+
+	FrameArena::~FrameArena()
+	{
+		for (size_t i = 0; i < m_blocks.size(); i++)
+			delete[] m_blocks[i].data;
+	}
+
+	void* FrameArena::Allocate(size_t size, size_t align)
+	{
+		Block* block = &m_blocks.back();
+		size_t address = (size_t)block->data + m_offset;
+		size_t padding = (align - address % align) % align;
+		if (m_offset + padding + size > block->size)
+		{
+			Block grown = { nullptr, std::max(block->size * 2, size + align) };
+			grown.data = new char[grown.size];
+			m_blocks.push_back(grown);
+			block = &m_blocks.back();
+			m_offset = 0;
+			address = (size_t)block->data;
+			padding = (align - address % align) % align;
+		}
+		m_offset += padding + size;
+		m_used += padding + size;
+		return block->data + m_offset - size;
+	}
+
+	void FrameArena::Reset()
+	{
+		if (m_blocks.size() > 1)
+		{
+			size_t total = 0;
+			for (size_t i = 0; i < m_blocks.size(); i++)
+			{
+				total += m_blocks[i].size;
+				delete[] m_blocks[i].data;
+			}
+			m_blocks.clear();
+			Block block = { new char[total], total };
+			m_blocks.push_back(block);
+		}
+		m_offset = 0;
+		m_used = 0;
+	}
+
+}
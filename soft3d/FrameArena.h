@@ -0,0 +1,42 @@
+#pragma once
+#include <boost/noncopyable.hpp>
+#include <algorithm>
+#include <type_traits>
+#include <new>
+#include <vector>
+
+namespace soft3d
+{
+
+	//bump allocator for data that lives for one frame, Reset drops every allocation at once;
+	//destructors never run so only trivially destructible types go in
+	class FrameArena : public boost::noncopyable
+	{
+	public:
+		explicit FrameArena(size_t capacity = 16 * 1024);
+		~FrameArena();
+
+		void* Allocate(size_t size, size_t align = 16);
+		template <typename T>
+		T* New(const T& val)
+		{
+			static_assert(std::is_trivially_destructible<T>::value, "FrameArena never runs destructors");
+			return new (Allocate(sizeof(T), std::alignment_of<T>::value)) T(val);
+		}
+
+		//blocks added by an overflowing frame are merged into one that fits the whole frame next time
+		void Reset();
+		inline size_t GetUsed() const { return m_used; }
+
+	private:
+		struct Block
+		{
+			char* data;
+			size_t size;
+		};
+		std::vector<Block> m_blocks;
+		size_t m_offset;//into the last block
+		size_t m_used;
+	};
+
+}
@@ -0,0 +1,106 @@
+#include "soft3d.h"
+#include "FrameBufferChain.h"
+#include "TiledSurface.h"
+#include <boost/bind.hpp>
+
+namespace soft3d
+{
+
+	FrameBufferChain::FrameBufferChain(uint16 width, uint16 height, uint32 count, const PRESENT_CB& present) :
+		m_width(width),
+		m_height(height),
+		m_current(0),
+		m_present(present),
+		m_stop(false)
+	{
+		count = std::max(count, 1u);
+		for (uint32 i = 0; i < count; i++)
+		{
+			uint32* buffer = (uint32*)TiledSurface::Allocate(width, height);
+			memset(buffer, 0, TiledSurface::GetPixelCount(width, height) * sizeof(uint32));
+			m_buffers.push_back(buffer);
+		}
+		m_linear.resize(width * height);
+		m_scaled.resize(width * height);
+		m_busy.resize(count, false);
+		m_frameSizes.resize(count, std::make_pair(width, height));
+		//started last, everything it reads is set up by now
+		m_thread = boost::thread(boost::bind(&FrameBufferChain::PresentThread, this));
+	}
+
+	FrameBufferChain::~FrameBufferChain()
+	{
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			m_stop = true;
+		}
+		m_queueCond.notify_all();
+		m_thread.join();
+		for (size_t i = 0; i < m_buffers.size(); i++)
+			TiledSurface::Free(m_buffers[i]);
+	}
+
+	uint32* FrameBufferChain::Acquire()
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_current = (m_current + 1) % m_buffers.size();
+		while (m_busy[m_current])
+			m_doneCond.wait(lock);
+		return m_buffers[m_current];
+	}
+
+	void FrameBufferChain::Present(uint16 width, uint16 height)
+	{
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			m_frameSizes[m_current] = std::make_pair(std::min(width, m_width), std::min(height, m_height));
+			m_busy[m_current] = true;
+			m_queue.push_back(m_current);
+		}
+		m_queueCond.notify_one();
+	}
+
+	void FrameBufferChain::Flush()
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		while (std::find(m_busy.begin(), m_busy.end(), true) != m_busy.end())
+			m_doneCond.wait(lock);
+	}
+
+	void FrameBufferChain::PresentThread()
+	{
+		while (true)
+		{
+			uint32 index;
+			std::pair<uint16, uint16> size;
+			{
+				boost::mutex::scoped_lock lock(m_mutex);
+				while (m_queue.empty() && !m_stop)
+					m_queueCond.wait(lock);
+				//frames still queued on shutdown are presented, Flush may be waiting on them
+				if (m_queue.empty())
+					return;
+				index = m_queue.front();
+				m_queue.pop_front();
+				size = m_frameSizes[index];
+			}
+			if (size.first == m_width && size.second == m_height)
+			{
+				TiledSurface::Detile(m_buffers[index], &m_linear[0], m_width, m_height);
+			}
+			else
+			{
+				TiledSurface::Detile(m_buffers[index], &m_scaled[0], size.first, size.second);
+				m_upscaler.Resize(size.first, size.second, m_width, m_height);
+				m_upscaler.Run(&m_scaled[0], &m_linear[0]);
+			}
+			m_present(&m_linear[0]);
+			{
+				boost::mutex::scoped_lock lock(m_mutex);
+				m_busy[index] = false;
+			}
+			m_doneCond.notify_all();
+		}
+	}
+
+}
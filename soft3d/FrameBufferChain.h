@@ -0,0 +1,60 @@
+#pragma once
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include <deque>
+#include <vector>
+#include "Upscaler.h"
+
+namespace soft3d
+{
+
+	//color buffers rotated frame by frame, a finished frame is presented on a thread of its own
+	//while the next one is rendered into another buffer, so a frame costs max(raster, present);
+	//the buffers are in the rasterizer's TiledSurface layout and are detiled on the present thread too,
+	//a frame rendered below the full size is scaled up there as well
+	class FrameBufferChain : public boost::noncopyable
+	{
+	public:
+		typedef boost::function<void(const uint32* buffer)> PRESENT_CB;
+
+		//count buffers of width * height pixels, present gets the detiled frame on the present thread
+		FrameBufferChain(uint16 width, uint16 height, uint32 count, const PRESENT_CB& present);
+		~FrameBufferChain();
+
+		//next buffer in turn, blocks while it is still being presented;
+		//it holds the frame rendered count frames ago
+		uint32* Acquire();
+		//queues the acquired buffer for present, the caller must not touch it until it is acquired again;
+		//the frame covers width * height of it, at least 2x2 and no more than the chain's size
+		void Present(uint16 width, uint16 height);
+		//blocks until every queued frame is presented
+		void Flush();
+
+		inline uint32 GetCount() const {
+			return m_buffers.size();
+		}
+
+	private:
+		void PresentThread();
+
+		std::vector<uint32*> m_buffers;
+		std::vector<uint32> m_linear;//detiled frame handed to present
+		std::vector<uint32> m_scaled;//detiled frame of a lower render size, before the upscale
+		Upscaler m_upscaler;
+		std::vector<std::pair<uint16, uint16> > m_frameSizes;//render size of every buffer
+		uint16 m_width;
+		uint16 m_height;
+		std::vector<bool> m_busy;//queued or being presented
+		std::deque<uint32> m_queue;
+		uint32 m_current;
+		PRESENT_CB m_present;
+
+		boost::mutex m_mutex;
+		boost::condition_variable m_queueCond;
+		boost::condition_variable m_doneCond;
+		bool m_stop;
+		boost::thread m_thread;
+	};
+
+}
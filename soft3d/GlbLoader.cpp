@@ -0,0 +1,451 @@
+#include "GlbLoader.h"
+#include "MappedFile.h"
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/foreach.hpp>
+#include <sstream>
+#include <algorithm>
+
+using boost::property_tree::ptree;
+using namespace vmath;
+
+namespace soft3d
+{
+
+	enum GLB_CONSTANT
+	{
+		GLB_MAGIC = 0x46546c67,//"glTF"
+		GLB_VERSION = 2,
+		GLB_CHUNK_JSON = 0x4e4f534a,
+		GLB_CHUNK_BIN = 0x004e4942,
+
+		GLTF_BYTE = 5120,
+		GLTF_UNSIGNED_BYTE = 5121,
+		GLTF_SHORT = 5122,
+		GLTF_UNSIGNED_SHORT = 5123,
+		GLTF_UNSIGNED_INT = 5125,
+		GLTF_FLOAT = 5126,
+
+		GLTF_TRIANGLES = 4,
+	};
+
+	struct GlbDocument
+	{
+		MappedFile file;
+		const char* bin;
+		uint32 binSize;
+		ptree json;
+		//json arrays flattened for random access
+		std::vector<const ptree*> accessors;
+		std::vector<const ptree*> bufferViews;
+		std::vector<const ptree*> meshes;
+		std::vector<const ptree*> nodes;
+	};
+
+	//typed view of accessor data inside the binary chunk
+	struct GlbAccessor
+	{
+		const char* data;
+		uint32 count;
+		uint32 stride;
+		uint32 componentType;
+		uint32 components;
+	};
+
+	static void FlattenArray(const ptree& json, const char* name, std::vector<const ptree*>& out)
+	{
+		boost::optional<const ptree&> array = json.get_child_optional(name);
+		if (!array)
+			return;
+		BOOST_FOREACH(const ptree::value_type& item, *array)
+			out.push_back(&item.second);
+	}
+
+	static uint32 ComponentSize(uint32 componentType)
+	{
+		switch (componentType)
+		{
+		case GLTF_BYTE:
+		case GLTF_UNSIGNED_BYTE:
+			return 1;
+		case GLTF_SHORT:
+		case GLTF_UNSIGNED_SHORT:
+			return 2;
+		case GLTF_UNSIGNED_INT:
+		case GLTF_FLOAT:
+			return 4;
+		default:
+			return 0;
+		}
+	}
+
+	static uint32 ComponentCount(const std::string& type)
+	{
+		if (type == "SCALAR")
+			return 1;
+		if (type == "VEC2")
+			return 2;
+		if (type == "VEC3")
+			return 3;
+		if (type == "VEC4")
+			return 4;
+		if (type == "MAT4")
+			return 16;
+		return 0;
+	}
+
+	//fails unless the accessor has at least one element lying wholly inside the BIN chunk,
+	//so callers may address element 0 and count - 1 without checking count themselves
+	static bool GetAccessor(const GlbDocument& doc, int index, GlbAccessor& accessor)
+	{
+		if (index < 0 || (uint32)index >= doc.accessors.size())
+			return false;
+		const ptree& acc = *doc.accessors[index];
+		int view = acc.get<int>("bufferView", -1);
+		if (view < 0 || (uint32)view >= doc.bufferViews.size())
+			return false;//sparse and zero filled accessors are not supported
+		const ptree& bv = *doc.bufferViews[view];
+		if (bv.get<int>("buffer", 0) != 0)
+			return false;//only the embedded BIN chunk, no external uris
+
+		accessor.componentType = acc.get<uint32>("componentType");
+		accessor.components = ComponentCount(acc.get<std::string>("type"));
+		accessor.count = acc.get<uint32>("count");
+		uint32 elementSize = ComponentSize(accessor.componentType) * accessor.components;
+		accessor.stride = bv.get<uint32>("byteStride", elementSize);
+		uint64 offset = bv.get<uint64>("byteOffset", 0) + acc.get<uint64>("byteOffset", 0);
+		if (elementSize == 0 || accessor.count == 0)
+			return false;
+		uint64 end = offset + (uint64)accessor.stride * (accessor.count - 1) + elementSize;
+		if (end > bv.get<uint64>("byteOffset", 0) + bv.get<uint64>("byteLength") || end > doc.binSize)
+			return false;
+		accessor.data = doc.bin + offset;
+		return true;
+	}
+
+	static mat4 NodeMatrix(const ptree& node)
+	{
+		mat4 m = mat4::identity();
+		boost::optional<const ptree&> matrix = node.get_child_optional("matrix");
+		if (matrix)
+		{
+			//column major, same as vmath
+			int i = 0;
+			BOOST_FOREACH(const ptree::value_type& v, *matrix)
+			{
+				if (i < 16)
+					m[i / 4][i % 4] = v.second.get_value<float>();
+				i++;
+			}
+			return m;
+		}
+
+		float t[3] = { 0.0f, 0.0f, 0.0f };
+		float r[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+		float s[3] = { 1.0f, 1.0f, 1.0f };
+		const char* names[3] = { "translation", "rotation", "scale" };
+		float* values[3] = { t, r, s };
+		for (int k = 0; k < 3; k++)
+		{
+			boost::optional<const ptree&> array = node.get_child_optional(names[k]);
+			if (!array)
+				continue;
+			int i = 0;
+			BOOST_FOREACH(const ptree::value_type& v, *array)
+			{
+				if (i < (k == 1 ? 4 : 3))
+					values[k][i] = v.second.get_value<float>();
+				i++;
+			}
+		}
+
+		//T * R * S with the rotation quaternion stored x, y, z, w
+		float x = r[0], y = r[1], z = r[2], w = r[3];
+		m[0][0] = (1.0f - 2.0f * (y * y + z * z)) * s[0];
+		m[0][1] = (2.0f * (x * y + z * w)) * s[0];
+		m[0][2] = (2.0f * (x * z - y * w)) * s[0];
+		m[1][0] = (2.0f * (x * y - z * w)) * s[1];
+		m[1][1] = (1.0f - 2.0f * (x * x + z * z)) * s[1];
+		m[1][2] = (2.0f * (y * z + x * w)) * s[1];
+		m[2][0] = (2.0f * (x * z + y * w)) * s[2];
+		m[2][1] = (2.0f * (y * z - x * w)) * s[2];
+		m[2][2] = (1.0f - 2.0f * (x * x + y * y)) * s[2];
+		m[3][0] = t[0];
+		m[3][1] = t[1];
+		m[3][2] = t[2];
+		return m;
+	}
+
+	GlbLoader::GlbLoader()
+	{
+		m_hasUV = false;
+	}
+
+	GlbLoader::~GlbLoader()
+	{
+	}
+
+	int GlbLoader::LoadGlb(const char* glbName)
+	{
+		GlbDocument doc;
+		if (!doc.file.Open(glbName) || doc.file.GetSize() < 20)
+		{
+			printf("Can not open %s.\n", glbName);
+			return -1;
+		}
+
+		const char* base = (const char*)doc.file.GetData();
+		const uint32* header = (const uint32*)base;
+		if (header[0] != GLB_MAGIC || header[1] != GLB_VERSION || header[2] > doc.file.GetSize())
+		{
+			printf("%s is not a glTF 2.0 binary.\n", glbName);
+			return -1;
+		}
+
+		//chunk 0 is always JSON, an optional BIN chunk follows
+		uint32 size = header[2];
+		uint32 jsonLength = header[3];
+		if (header[4] != GLB_CHUNK_JSON || 20 + (uint64)jsonLength > size)
+			return -1;
+		doc.bin = nullptr;
+		doc.binSize = 0;
+		uint32 binChunk = 20 + ((jsonLength + 3) & ~3u);
+		if (binChunk + 8 <= size)
+		{
+			const uint32* chunk = (const uint32*)(base + binChunk);
+			if (chunk[1] == GLB_CHUNK_BIN && binChunk + 8 + (uint64)chunk[0] <= size)
+			{
+				doc.bin = base + binChunk + 8;
+				doc.binSize = chunk[0];
+			}
+		}
+
+		try
+		{
+			std::istringstream json(std::string(base + 20, jsonLength));
+			boost::property_tree::read_json(json, doc.json);
+		}
+		catch (const boost::property_tree::json_parser_error& e)
+		{
+			printf("Error parsing %s: %s\n", glbName, e.what());
+			return -1;
+		}
+		FlattenArray(doc.json, "accessors", doc.accessors);
+		FlattenArray(doc.json, "bufferViews", doc.bufferViews);
+		FlattenArray(doc.json, "meshes", doc.meshes);
+		FlattenArray(doc.json, "nodes", doc.nodes);
+
+		m_vertexBuffer.clear();
+		m_indexBuffer.clear();
+		m_normalBuffer.clear();
+		m_uvBuffer.clear();
+		m_hasUV = false;
+
+		try
+		{
+			std::vector<const ptree*> scenes;
+			FlattenArray(doc.json, "scenes", scenes);
+			uint32 scene = doc.json.get<uint32>("scene", 0);
+			if (scene < scenes.size())
+			{
+				boost::optional<const ptree&> roots = scenes[scene]->get_child_optional("nodes");
+				if (roots)
+				{
+					BOOST_FOREACH(const ptree::value_type& root, *roots)
+						LoadNode(doc, root.second.get_value<uint32>(), mat4::identity(), 0);
+				}
+			}
+			else
+			{
+				//no scene, take every mesh as is
+				for (uint32 i = 0; i < doc.meshes.size(); i++)
+					LoadMesh(doc, i, mat4::identity());
+			}
+		}
+		catch (const boost::property_tree::ptree_error& e)
+		{
+			printf("Error reading %s: %s\n", glbName, e.what());
+			return -1;
+		}
+
+		if (!m_hasUV)
+			m_uvBuffer.clear();
+		return 0;
+	}
+
+	void GlbLoader::LoadNode(const GlbDocument& doc, uint32 node, const mat4& parent, uint32 depth)
+	{
+		//depth bounds cyclic node graphs in malformed files
+		if (node >= doc.nodes.size() || depth > 64)
+			return;
+		const ptree& n = *doc.nodes[node];
+		mat4 world = parent * NodeMatrix(n);
+
+		int mesh = n.get<int>("mesh", -1);
+		if (mesh >= 0)
+			LoadMesh(doc, mesh, world);
+
+		boost::optional<const ptree&> children = n.get_child_optional("children");
+		if (children)
+		{
+			BOOST_FOREACH(const ptree::value_type& child, *children)
+				LoadNode(doc, child.second.get_value<uint32>(), world, depth + 1);
+		}
+	}
+
+	void GlbLoader::LoadMesh(const GlbDocument& doc, uint32 mesh, const mat4& world)
+	{
+		if (mesh >= doc.meshes.size())
+			return;
+		boost::optional<const ptree&> primitives = doc.meshes[mesh]->get_child_optional("primitives");
+		if (!primitives)
+			return;
+
+		const mat4 unit = mat4::identity();
+		bool identity = memcmp(&world, &unit, sizeof(mat4)) == 0;
+		//normals go through the cofactor matrix, which is the inverse transpose up to a scale
+		float nm[3][3];
+		for (int c = 0; c < 3; c++)
+		{
+			for (int r = 0; r < 3; r++)
+			{
+				int c1 = (c + 1) % 3, c2 = (c + 2) % 3, r1 = (r + 1) % 3, r2 = (r + 2) % 3;
+				nm[c][r] = world[c1][r1] * world[c2][r2] - world[c1][r2] * world[c2][r1];
+			}
+		}
+		//the cofactor matrix is det times the inverse transpose, so a mirroring node
+		//(det < 0) would turn the normals inward; it also reverses the triangle winding
+		float det = world[0][0] * nm[0][0] + world[0][1] * nm[0][1] + world[0][2] * nm[0][2];
+		bool mirrored = det < 0.0f;
+		if (mirrored)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				for (int r = 0; r < 3; r++)
+					nm[c][r] = -nm[c][r];
+			}
+		}
+
+		BOOST_FOREACH(const ptree::value_type& item, *primitives)
+		{
+			const ptree& prim = item.second;
+			if (prim.get<int>("mode", GLTF_TRIANGLES) != GLTF_TRIANGLES)
+				continue;
+
+			GlbAccessor pos;
+			if (!GetAccessor(doc, prim.get<int>("attributes.POSITION", -1), pos)
+				|| pos.componentType != GLTF_FLOAT || pos.components != 3)
+				continue;
+
+			uint32 base = m_vertexBuffer.size() / 4;
+			uint32 firstIndex = m_indexBuffer.size();
+			m_vertexBuffer.resize((base + pos.count) * 4);
+			float* dst = &m_vertexBuffer[base * 4];
+			for (uint32 i = 0; i < pos.count; i++, dst += 4)
+			{
+				const float* p = (const float*)(pos.data + i * pos.stride);
+				if (identity)
+				{
+					dst[0] = p[0];
+					dst[1] = p[1];
+					dst[2] = p[2];
+				}
+				else
+				{
+					for (int r = 0; r < 3; r++)
+						dst[r] = world[0][r] * p[0] + world[1][r] * p[1] + world[2][r] * p[2] + world[3][r];
+				}
+				dst[3] = 1.0f;
+			}
+
+			GlbAccessor idx;
+			if (GetAccessor(doc, prim.get<int>("indices", -1), idx) && idx.components == 1)
+			{
+				m_indexBuffer.resize(firstIndex + idx.count);
+				uint32* out = &m_indexBuffer[firstIndex];
+				if (idx.componentType == GLTF_UNSIGNED_INT && idx.stride == 4 && base == 0)
+					memcpy(out, idx.data, idx.count * sizeof(uint32));
+				else
+				{
+					for (uint32 i = 0; i < idx.count; i++)
+					{
+						const char* src = idx.data + i * idx.stride;
+						uint32 v;
+						if (idx.componentType == GLTF_UNSIGNED_BYTE)
+							v = *(const unsigned char*)src;
+						else if (idx.componentType == GLTF_UNSIGNED_SHORT)
+							v = *(const unsigned short*)src;
+						else
+							v = *(const uint32*)src;
+						out[i] = base + v;
+					}
+				}
+			}
+			else
+			{
+				m_indexBuffer.resize(firstIndex + pos.count);
+				for (uint32 i = 0; i < pos.count; i++)
+					m_indexBuffer[firstIndex + i] = base + i;
+			}
+			uint32 indexCount = m_indexBuffer.size() - firstIndex;
+			const uint32* indices = &m_indexBuffer[firstIndex];
+			//clamp so a bad index can not read past the vertices of this primitive
+			for (uint32 i = 0; i < indexCount; i++)
+			{
+				if (indices[i] - base >= pos.count)
+					m_indexBuffer[firstIndex + i] = base + pos.count - 1;
+			}
+			if (mirrored)
+			{
+				for (uint32 i = 0; i + 2 < indexCount; i += 3)
+					std::swap(m_indexBuffer[firstIndex + i + 1], m_indexBuffer[firstIndex + i + 2]);
+			}
+
+			//glTF attributes are already per vertex, which is the welded layout
+			m_normalBuffer.resize((base + pos.count) * 3, 0.0f);
+			GlbAccessor nor;
+			if (GetAccessor(doc, prim.get<int>("attributes.NORMAL", -1), nor)
+				&& nor.componentType == GLTF_FLOAT && nor.components == 3 && nor.count == pos.count)
+			{
+				float* out = &m_normalBuffer[base * 3];
+				for (uint32 i = 0; i < nor.count; i++, out += 3)
+				{
+					const float* n = (const float*)(nor.data + i * nor.stride);
+					if (identity)
+					{
+						out[0] = n[0];
+						out[1] = n[1];
+						out[2] = n[2];
+						continue;
+					}
+					vec3 t;
+					for (int r = 0; r < 3; r++)
+						t[r] = nm[0][r] * n[0] + nm[1][r] * n[1] + nm[2][r] * n[2];
+					float len = length(t);
+					if (len > 0.0f)
+						t /= len;
+					out[0] = t[0];
+					out[1] = t[1];
+					out[2] = t[2];
+				}
+			}
+
+			m_uvBuffer.resize((base + pos.count) * 2, 0.0f);
+			GlbAccessor uv;
+			if (GetAccessor(doc, prim.get<int>("attributes.TEXCOORD_0", -1), uv)
+				&& uv.componentType == GLTF_FLOAT && uv.components == 2 && uv.count == pos.count)
+			{
+				m_hasUV = true;
+				float* out = &m_uvBuffer[base * 2];
+				for (uint32 i = 0; i < uv.count; i++, out += 2)
+				{
+					const float* t = (const float*)(uv.data + i * uv.stride);
+					//glTF puts v = 0 at the top of the image, FBX at the bottom
+					out[0] = t[0];
+					out[1] = 1.0f - t[1];
+				}
+			}
+		}
+	}
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "soft3d.h"
+#include <vector>
+
+namespace soft3d
+{
+
+	struct GlbDocument;
+
+	//glTF 2.0 binary loader, every triangle primitive reachable from the default scene is baked
+	//into one set of buffers laid out like FbxLoader's: xyzw positions, normals and uvs per vertex
+	class GlbLoader
+	{
+	public:
+		GlbLoader();
+		~GlbLoader();
+
+		int LoadGlb(const char* glbName);
+
+		const float* GetVertexBuffer() const
+		{
+			return m_vertexBuffer.empty() ? nullptr : &m_vertexBuffer[0];
+		}
+		uint32 GetVertexCount() const
+		{
+			return m_vertexBuffer.size() / 4;
+		}
+
+		const uint32* GetIndexBuffer() const
+		{
+			return m_indexBuffer.empty() ? nullptr : &m_indexBuffer[0];
+		}
+		uint32 GetIndexCount() const
+		{
+			return m_indexBuffer.size();
+		}
+
+		const float* GetNormalBuffer() const
+		{
+			return m_normalBuffer.empty() ? nullptr : &m_normalBuffer[0];
+		}
+		uint32 GetNormalCount() const
+		{
+			return m_normalBuffer.size() / 3;
+		}
+
+		const float* GetUVBuffer() const
+		{
+			return m_uvBuffer.empty() ? nullptr : &m_uvBuffer[0];
+		}
+		uint32 GetUVCount() const
+		{
+			return m_uvBuffer.size() / 2;
+		}
+
+	private:
+		void LoadNode(const GlbDocument& doc, uint32 node, const vmath::mat4& parent, uint32 depth);
+		void LoadMesh(const GlbDocument& doc, uint32 mesh, const vmath::mat4& world);
+
+	private:
+		std::vector<float> m_vertexBuffer;
+		std::vector<uint32> m_indexBuffer;
+		std::vector<float> m_normalBuffer;
+		std::vector<float> m_uvBuffer;
+		bool m_hasUV;
+	};
+
+}
@@ -0,0 +1,105 @@
+#include "MappedFile.h"
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace soft3d
+{
+
+	MappedFile::MappedFile()
+	{
+#ifdef _WIN32
+		m_file = INVALID_HANDLE_VALUE;
+		m_mapping = NULL;
+#else
+		m_fd = -1;
+#endif
+		m_data = nullptr;
+		m_size = 0;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	bool MappedFile::Open(const char* filename)
+	{
+		Close();
+#ifdef _WIN32
+		m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (m_file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+		{
+			Close();
+			return false;
+		}
+		m_size = (size_t)size.QuadPart;
+		m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (m_mapping == NULL)
+		{
+			Close();
+			return false;
+		}
+		m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		m_fd = open(filename, O_RDONLY);
+		if (m_fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(m_fd, &st) != 0 || st.st_size == 0)
+		{
+			Close();
+			return false;
+		}
+		m_size = (size_t)st.st_size;
+		m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+		if (m_data == MAP_FAILED)
+			m_data = nullptr;
+#endif
+		if (m_data == nullptr)
+		{
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+#ifdef _WIN32
+		if (m_data != nullptr)
+			UnmapViewOfFile(m_data);
+		if (m_mapping != NULL)
+			CloseHandle(m_mapping);
+		if (m_file != INVALID_HANDLE_VALUE)
+			CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+		m_mapping = NULL;
+#else
+		if (m_data != nullptr)
+			munmap(m_data, m_size);
+		if (m_fd >= 0)
+			close(m_fd);
+		m_fd = -1;
+#endif
+		m_data = nullptr;
+		m_size = 0;
+	}
+
+	unsigned long long MappedFile::GetFileStamp(const char* filename)
+	{
+		struct stat st;
+		if (stat(filename, &st) != 0)
+			return 0;
+		return ((unsigned long long)st.st_mtime << 32) ^ (unsigned long long)st.st_size;
+	}
+
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <stddef.h>
+#include <boost/noncopyable.hpp>
+
+namespace soft3d
+{
+
+	//read only view of a whole file, CreateFileMapping on windows and mmap elsewhere
+	class MappedFile : public boost::noncopyable
+	{
+	public:
+		MappedFile();
+		~MappedFile();
+
+		bool Open(const char* filename);
+		void Close();
+
+		const void* GetData() const {
+			return m_data;
+		}
+		size_t GetSize() const {
+			return m_size;
+		}
+
+		//size and mtime of a file folded into one value, 0 when the file is missing;
+		//caches derived from a file store it to notice when the source changes
+		static unsigned long long GetFileStamp(const char* filename);
+
+	private:
+#ifdef _WIN32
+		void* m_file;
+		void* m_mapping;
+#else
+		int m_fd;
+#endif
+		void* m_data;
+		size_t m_size;
+	};
+
+}
@@ -0,0 +1,190 @@
+#include "soft3d.h"
+#include "MeshCache.h"
+#include "MappedFile.h"
+#include <float.h>
+
+namespace soft3d
+{
+
+	struct MeshCacheHeader
+	{
+		enum { MAGIC = 0x48534d53, VERSION = 3 };//"SMSH", version 3 holds a table of welded meshes
+		uint32 magic;
+		uint32 version;
+		uint64 stamp;
+		uint32 meshCount;//MeshCacheEntry records follow the header
+		uint32 reserved;
+		float boundsMin[3];
+		float boundsMax[3];
+	};
+
+	struct MeshCacheEntry
+	{
+		enum SECTION { SECTION_VERTEX, SECTION_INDEX, SECTION_NORMAL, SECTION_UV, SECTION_COUNT };
+		uint32 count[SECTION_COUNT];
+		uint64 offset[SECTION_COUNT];//from the start of the file, 64 byte aligned
+		float transform[16];
+		float boundsMin[3];
+		float boundsMax[3];
+	};
+
+	//elements of a section, in 4 byte words
+	static const uint32 s_sectionStride[MeshCacheEntry::SECTION_COUNT] = { 4, 1, 3, 2 };
+
+	static inline uint64 AlignSectionOffset(uint64 offset)
+	{
+		return (offset + 63) & ~(uint64)63;
+	}
+
+	//grows min/max by the eight corners of a mesh space box placed by transform
+	static void GrowPlacedBounds(const float* boxMin, const float* boxMax, const vmath::mat4& transform, float* min, float* max)
+	{
+		for (int corner = 0; corner < 8; corner++)
+		{
+			float p[3] = {
+				(corner & 1) ? boxMax[0] : boxMin[0],
+				(corner & 2) ? boxMax[1] : boxMin[1],
+				(corner & 4) ? boxMax[2] : boxMin[2] };
+			for (int r = 0; r < 3; r++)
+			{
+				float v = transform[0][r] * p[0] + transform[1][r] * p[1] + transform[2][r] * p[2] + transform[3][r];
+				min[r] = std::min(min[r], v);
+				max[r] = std::max(max[r], v);
+			}
+		}
+	}
+
+	MeshCache::MeshCache()
+	{
+	}
+
+	MeshCache::~MeshCache()
+	{
+	}
+
+	bool MeshCache::Save(const char* filename, uint64 stamp, const std::vector<Mesh>& meshes)
+	{
+		MeshCacheHeader header = {};
+		header.magic = MeshCacheHeader::MAGIC;
+		header.version = MeshCacheHeader::VERSION;
+		header.stamp = stamp;
+		header.meshCount = meshes.size();
+		for (int k = 0; k < 3; k++)
+		{
+			header.boundsMin[k] = FLT_MAX;
+			header.boundsMax[k] = -FLT_MAX;
+		}
+
+		std::vector<MeshCacheEntry> table(meshes.size());
+		uint64 offset = AlignSectionOffset(sizeof(header) + sizeof(MeshCacheEntry) * table.size());
+		for (size_t m = 0; m < meshes.size(); m++)
+		{
+			const Mesh& mesh = meshes[m];
+			MeshCacheEntry& entry = table[m];
+			const void* sections[MeshCacheEntry::SECTION_COUNT] = { mesh.vertices, mesh.indices, mesh.normals, mesh.uvs };
+			uint32 counts[MeshCacheEntry::SECTION_COUNT] = { mesh.vertexCount, mesh.indexCount, mesh.normalCount, mesh.uvCount };
+			for (int i = 0; i < MeshCacheEntry::SECTION_COUNT; i++)
+			{
+				entry.count[i] = sections[i] != nullptr ? counts[i] : 0;
+				entry.offset[i] = offset;
+				offset = AlignSectionOffset(offset + entry.count[i] * s_sectionStride[i] * sizeof(uint32));
+			}
+			memcpy(entry.transform, &mesh.transform, sizeof(entry.transform));
+
+			uint32 vertexCount = entry.count[MeshCacheEntry::SECTION_VERTEX];
+			for (int k = 0; k < 3; k++)
+			{
+				entry.boundsMin[k] = vertexCount > 0 ? mesh.vertices[k] : 0.0f;
+				entry.boundsMax[k] = entry.boundsMin[k];
+			}
+			for (uint32 i = 1; i < vertexCount; i++)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					entry.boundsMin[k] = std::min(entry.boundsMin[k], mesh.vertices[i * 4 + k]);
+					entry.boundsMax[k] = std::max(entry.boundsMax[k], mesh.vertices[i * 4 + k]);
+				}
+			}
+			if (vertexCount > 0)
+				GrowPlacedBounds(entry.boundsMin, entry.boundsMax, mesh.transform, header.boundsMin, header.boundsMax);
+		}
+		if (header.boundsMin[0] > header.boundsMax[0])
+		{
+			for (int k = 0; k < 3; k++)
+				header.boundsMin[k] = header.boundsMax[k] = 0.0f;
+		}
+
+		FILE* file = fopen(filename, "wb");
+		if (file == nullptr)
+			return false;
+		static const char zeros[64] = {};
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+			&& (table.empty() || fwrite(&table[0], sizeof(MeshCacheEntry), table.size(), file) == table.size());
+		uint64 written = sizeof(header) + sizeof(MeshCacheEntry) * table.size();
+		for (size_t m = 0; ok && m < meshes.size(); m++)
+		{
+			const Mesh& mesh = meshes[m];
+			const void* sections[MeshCacheEntry::SECTION_COUNT] = { mesh.vertices, mesh.indices, mesh.normals, mesh.uvs };
+			for (int i = 0; ok && i < MeshCacheEntry::SECTION_COUNT; i++)
+			{
+				const MeshCacheEntry& entry = table[m];
+				size_t size = entry.count[i] * s_sectionStride[i] * sizeof(uint32);
+				ok = fwrite(zeros, 1, (size_t)(entry.offset[i] - written), file) == entry.offset[i] - written
+					&& (size == 0 || fwrite(sections[i], 1, size, file) == size);
+				written = entry.offset[i] + size;
+			}
+		}
+		ok = fclose(file) == 0 && ok;
+		if (!ok)
+			remove(filename);
+		return ok;
+	}
+
+	bool MeshCache::Open(const char* filename, uint64 stamp)
+	{
+		std::shared_ptr<MappedFile> mapping(new MappedFile());
+		if (!mapping->Open(filename) || mapping->GetSize() < sizeof(MeshCacheHeader))
+			return false;
+
+		const char* base = (const char*)mapping->GetData();
+		const MeshCacheHeader* header = (const MeshCacheHeader*)base;
+		if (header->magic != MeshCacheHeader::MAGIC || header->version != MeshCacheHeader::VERSION || header->stamp != stamp
+			|| sizeof(MeshCacheHeader) + sizeof(MeshCacheEntry) * (uint64)header->meshCount > mapping->GetSize())
+			return false;
+
+		const MeshCacheEntry* table = (const MeshCacheEntry*)(base + sizeof(MeshCacheHeader));
+		std::vector<Mesh> meshes(header->meshCount);
+		for (uint32 m = 0; m < header->meshCount; m++)
+		{
+			const MeshCacheEntry& entry = table[m];
+			const void* sections[MeshCacheEntry::SECTION_COUNT];
+			for (int i = 0; i < MeshCacheEntry::SECTION_COUNT; i++)
+			{
+				uint64 size = (uint64)entry.count[i] * s_sectionStride[i] * sizeof(uint32);
+				if ((entry.offset[i] & 63) != 0 || entry.offset[i] + size > mapping->GetSize())
+					return false;
+				sections[i] = entry.count[i] > 0 ? base + entry.offset[i] : nullptr;
+			}
+
+			Mesh& mesh = meshes[m];
+			mesh.vertices = (const float*)sections[MeshCacheEntry::SECTION_VERTEX];
+			mesh.vertexCount = entry.count[MeshCacheEntry::SECTION_VERTEX];
+			mesh.indices = (const uint32*)sections[MeshCacheEntry::SECTION_INDEX];
+			mesh.indexCount = entry.count[MeshCacheEntry::SECTION_INDEX];
+			mesh.normals = (const float*)sections[MeshCacheEntry::SECTION_NORMAL];
+			mesh.normalCount = entry.count[MeshCacheEntry::SECTION_NORMAL];
+			mesh.uvs = (const float*)sections[MeshCacheEntry::SECTION_UV];
+			mesh.uvCount = entry.count[MeshCacheEntry::SECTION_UV];
+			memcpy(&mesh.transform, entry.transform, sizeof(entry.transform));
+			mesh.boundsMin = vmath::vec3(entry.boundsMin[0], entry.boundsMin[1], entry.boundsMin[2]);
+			mesh.boundsMax = vmath::vec3(entry.boundsMax[0], entry.boundsMax[1], entry.boundsMax[2]);
+		}
+
+		m_mapping = mapping;
+		m_meshes.swap(meshes);
+		m_boundsMin = vmath::vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]);
+		m_boundsMax = vmath::vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]);
+		return true;
+	}
+
+}
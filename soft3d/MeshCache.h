@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+
+namespace soft3d
+{
+
+	class MappedFile;
+
+	//read only meshes loaded from a binary cache file, every section points into the mapping
+	class MeshCache
+	{
+	public:
+		MeshCache();
+		~MeshCache();
+
+		//one entry of the mesh table, layout matches the FbxLoader buffers:
+		//xyzw positions, xyz normals and uv pairs per vertex, counts are in vertices
+		struct Mesh
+		{
+			const float* vertices;
+			uint32 vertexCount;
+			const uint32* indices;
+			uint32 indexCount;
+			const float* normals;
+			uint32 normalCount;
+			const float* uvs;
+			uint32 uvCount;
+			vmath::mat4 transform;//node global transform, places the mesh in the scene
+			vmath::vec3 boundsMin;//of the positions in mesh space, filled in by Save
+			vmath::vec3 boundsMax;
+		};
+
+		static bool Save(const char* filename, uint64 stamp, const std::vector<Mesh>& meshes);
+
+		//fails when the file is missing, truncated, of another version or written for another stamp
+		bool Open(const char* filename, uint64 stamp);
+
+		uint32 GetMeshCount() const {
+			return m_meshes.size();
+		}
+		const Mesh& GetMesh(uint32 index) const {
+			return m_meshes[index];
+		}
+		const std::vector<Mesh>& GetMeshes() const {
+			return m_meshes;
+		}
+		//of every mesh placed by its transform
+		const vmath::vec3& GetBoundsMin() const {
+			return m_boundsMin;
+		}
+		const vmath::vec3& GetBoundsMax() const {
+			return m_boundsMax;
+		}
+
+	private:
+		std::shared_ptr<MappedFile> m_mapping;
+
+		std::vector<Mesh> m_meshes;
+		vmath::vec3 m_boundsMin;
+		vmath::vec3 m_boundsMax;
+	};
+
+}
@@ -0,0 +1,93 @@
+#include "MeshWelder.h"
+
+namespace soft3d
+{
+
+	enum { WELD_FLOATS = 10 };//xyzw, normal xyz, uv, control point when tracking sources
+
+	static inline uint32 HashKey(const float* key)
+	{
+		//FNV-1a over the raw bits, -0.0 and 0.0 stay different vertices which is harmless
+		uint32 h = 2166136261u;
+		const uint32* bits = (const uint32*)key;
+		for (int i = 0; i < WELD_FLOATS; i++)
+			h = (h ^ bits[i]) * 16777619u;
+		return h;
+	}
+
+	void MeshWelder::Weld(std::vector<float>& vertices, std::vector<uint32>& indices,
+		std::vector<float>& normals, std::vector<float>& uvs, std::vector<uint32>* sources)
+	{
+		uint32 indexCount = indices.size();
+		uint32 vertexCount = vertices.size() / 4;
+		if (indexCount == 0 || vertexCount == 0)
+			return;
+		bool hasNormal = normals.size() >= indexCount * 3;
+		bool hasUV = uvs.size() >= indexCount * 2;
+
+		std::vector<float> outVertices, outNormals, outUVs;
+		outVertices.reserve(vertices.size());
+		if (hasNormal)
+			outNormals.reserve(vertexCount * 3);
+		if (hasUV)
+			outUVs.reserve(vertexCount * 2);
+		if (sources != nullptr)
+		{
+			sources->clear();
+			sources->reserve(vertexCount);
+		}
+
+		//open addressing on welded vertex ids, at most half full
+		uint32 tableSize = 16;
+		while (tableSize < indexCount * 2)
+			tableSize <<= 1;
+		std::vector<uint32> table(tableSize, 0xffffffff);
+		std::vector<float> keys;
+		keys.reserve(vertexCount * WELD_FLOATS);
+
+		for (uint32 i = 0; i < indexCount; i++)
+		{
+			float key[WELD_FLOATS] = {};
+			uint32 cp = std::min(indices[i], vertexCount - 1);
+			memcpy(key, &vertices[cp * 4], 4 * sizeof(float));
+			if (hasNormal)
+				memcpy(key + 4, &normals[i * 3], 3 * sizeof(float));
+			if (hasUV)
+				memcpy(key + 7, &uvs[i * 2], 2 * sizeof(float));
+			if (sources != nullptr)
+				memcpy(key + 9, &cp, sizeof(uint32));
+
+			uint32 slot = HashKey(key) & (tableSize - 1);
+			while (true)
+			{
+				uint32 id = table[slot];
+				if (id == 0xffffffff)
+				{
+					id = outVertices.size() / 4;
+					table[slot] = id;
+					keys.insert(keys.end(), key, key + WELD_FLOATS);
+					outVertices.insert(outVertices.end(), key, key + 4);
+					if (hasNormal)
+						outNormals.insert(outNormals.end(), key + 4, key + 7);
+					if (hasUV)
+						outUVs.insert(outUVs.end(), key + 7, key + 9);
+					if (sources != nullptr)
+						sources->push_back(cp);
+					indices[i] = id;
+					break;
+				}
+				if (memcmp(&keys[id * WELD_FLOATS], key, sizeof(key)) == 0)
+				{
+					indices[i] = id;
+					break;
+				}
+				slot = (slot + 1) & (tableSize - 1);
+			}
+		}
+
+		vertices.swap(outVertices);
+		normals.swap(outNormals);
+		uvs.swap(outUVs);
+	}
+
+}
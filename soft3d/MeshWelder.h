@@ -0,0 +1,21 @@
+#pragma once
+#include "soft3d.h"
+#include <vector>
+
+namespace soft3d
+{
+
+	//turns control point positions plus per index attributes into one indexed vertex buffer
+	//where every unique (position, normal, uv) tuple appears once
+	class MeshWelder
+	{
+	public:
+		//in: vertices xyzw per control point, normals xyz and uvs uv per index, either may be empty;
+		//out: all three per welded vertex and indices pointing at them;
+		//sources, when given, receives the control point of every welded vertex and keeps control
+		//points apart even where they share a position, for data like skin weights keyed on them
+		static void Weld(std::vector<float>& vertices, std::vector<uint32>& indices,
+			std::vector<float>& normals, std::vector<float>& uvs, std::vector<uint32>* sources = nullptr);
+	};
+
+}
@@ -0,0 +1,114 @@
+#include "soft3d.h"
+#include "QualityGovernor.h"
+#include <assert.h>
+
+namespace soft3d
+{
+
+	namespace
+	{
+		//cheapest loss of quality first
+		struct QualityStep
+		{
+			bool cheapFilter;
+			QualityKnobs::LIGHTING lighting;
+			float lodBias;
+			uint32 shadingShift;
+		};
+
+		const QualityStep s_ladder[] =
+		{
+			{ false, QualityKnobs::LIGHTING_FULL, 0.0f, 0 },
+			{ false, QualityKnobs::LIGHTING_FAST, 0.0f, 0 },
+			{ false, QualityKnobs::LIGHTING_FAST, 1.0f, 0 },
+			{ true, QualityKnobs::LIGHTING_FAST, 1.0f, 0 },
+			{ true, QualityKnobs::LIGHTING_FAST, 1.0f, 1 },
+			{ true, QualityKnobs::LIGHTING_DIFFUSE, 2.0f, 1 },
+		};
+
+		const uint32 DOWN_FRAMES = 4;
+		const uint32 UP_FRAMES = 60;
+		const uint32 MAX_UP_FRAMES = 960;
+		const float UP_THRESHOLD = 0.8f;//of the budget
+	}
+
+	QualityGovernor::QualityGovernor() :
+		m_budgetMs(0.0f),
+		m_overFrames(0),
+		m_underFrames(0),
+		m_upFrames(UP_FRAMES),
+		m_framesSinceStep(0),
+		m_lastStepUp(false)
+	{
+	}
+
+	uint32 QualityGovernor::GetLevelCount()
+	{
+		return sizeof(s_ladder) / sizeof(s_ladder[0]);
+	}
+
+	void QualityGovernor::SetBudget(float budgetMs)
+	{
+		m_budgetMs = std::max(budgetMs, 0.0f);
+		m_overFrames = 0;
+		m_underFrames = 0;
+		m_upFrames = UP_FRAMES;
+		m_lastStepUp = false;
+		SetLevel(0);
+	}
+
+	void QualityGovernor::SetLevel(uint32 level)
+	{
+		const QualityStep& step = s_ladder[level];
+		assert(step.shadingShift <= QualityKnobs::MAX_SHADING_SHIFT);
+		m_knobs.level = level;
+		m_knobs.cheapFilter = step.cheapFilter;
+		m_knobs.lighting = step.lighting;
+		m_knobs.lodBias = step.lodBias;
+		m_knobs.shadingShift = step.shadingShift;
+		m_framesSinceStep = 0;
+	}
+
+	const QualityKnobs& QualityGovernor::Update(const FrameTimings& timings)
+	{
+		if (m_budgetMs <= 0.0f || timings.frameMs <= 0.0f)
+			return m_knobs;
+		m_framesSinceStep++;
+
+		//the knobs only make the raster cheaper, a frame held up by the front end would lose quality for nothing
+		bool rasterBound = timings.rasterMs >= timings.frontMs;
+		if (timings.frameMs > m_budgetMs && rasterBound)
+		{
+			m_overFrames++;
+			m_underFrames = 0;
+		}
+		else if (timings.frameMs < m_budgetMs * UP_THRESHOLD)
+		{
+			m_underFrames++;
+			m_overFrames = 0;
+		}
+		else
+		{
+			m_overFrames = 0;
+			m_underFrames = 0;
+		}
+
+		if (m_overFrames >= DOWN_FRAMES && m_knobs.level + 1 < GetLevelCount())
+		{
+			//the level above did not hold, try it again less often
+			if (m_lastStepUp && m_framesSinceStep < m_upFrames)
+				m_upFrames = std::min(m_upFrames * 2, MAX_UP_FRAMES);
+			m_lastStepUp = false;
+			m_overFrames = 0;
+			SetLevel(m_knobs.level + 1);
+		}
+		else if (m_underFrames >= m_upFrames && m_knobs.level > 0)
+		{
+			m_lastStepUp = true;
+			m_underFrames = 0;
+			SetLevel(m_knobs.level - 1);
+		}
+		return m_knobs;
+	}
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "QualityKnobs.h"
+
+namespace soft3d
+{
+
+	//times of the stages of one frame, the front end runs while the last frame rasterizes
+	struct FrameTimings
+	{
+		float frameMs = 0.0f;//from one Process to the next
+		float frontMs = 0.0f;//scene update, vertex stage and binning
+		float rasterMs = 0.0f;//from the hand over to the rasterizers until they are done
+	};
+
+	//steps the quality knobs down a fixed ladder while frames miss the budget and back up while they are well
+	//within it; a step needs several frames in a row and a step up that gets undone waits twice as long the next time
+	class QualityGovernor
+	{
+	public:
+		QualityGovernor();
+
+		//budgetMs of 0 turns it off and goes back to full quality
+		void SetBudget(float budgetMs);
+		inline float GetBudget() const {
+			return m_budgetMs;
+		}
+
+		//feeds the timings of the last frame, returns the knobs of the next one
+		const QualityKnobs& Update(const FrameTimings& timings);
+		inline const QualityKnobs& GetKnobs() const {
+			return m_knobs;
+		}
+
+		static uint32 GetLevelCount();
+
+	private:
+		void SetLevel(uint32 level);
+
+		float m_budgetMs;
+		QualityKnobs m_knobs;
+		uint32 m_overFrames;
+		uint32 m_underFrames;
+		uint32 m_upFrames;//frames within budget it takes to step up
+		uint32 m_framesSinceStep;
+		bool m_lastStepUp;
+	};
+
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+namespace soft3d
+{
+
+	//per frame settings that trade image quality for fragment cost, full quality by default
+	struct QualityKnobs
+	{
+		enum
+		{
+			MAX_SHADING_SHIFT = 2,//4x4 blocks, the rasterizer clamps to it
+		};
+
+		enum LIGHTING
+		{
+			LIGHTING_FULL,//exact normalize and pow
+			LIGHTING_FAST,//rsqrt estimate normalize, specular power by squaring
+			LIGHTING_DIFFUSE,//fast normalize and no specular term
+		};
+
+		uint32 level = 0;//step of the governor, 0 is full quality
+		bool cheapFilter = false;//bilinear sampled as nearest, trilinear as nearest mipmap
+		LIGHTING lighting = LIGHTING_FULL;
+		float lodBias = 0.0f;//added to the mip level of every sample, only mipmapped textures are affected
+		uint32 shadingShift = 0;//blocks of 1 << shadingShift pixels per side share the color of one shaded pixel
+	};
+
+}
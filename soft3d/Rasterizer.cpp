@@ -3,15 +3,20 @@
 #include "VertexBufferObject.h"
 #include <vector>
 #include <stdlib.h>
+#include <assert.h>
 #include <boost/bind.hpp>
 
 #include "Rasterizer.h"
+#include "TileGrid.h"
+#include "TiledSurface.h"
 
 using namespace vmath;
 
 namespace soft3d
 {
 	uint32* Rasterizer::m_frameBuffer = nullptr;
+	uint32* Rasterizer::m_defaultFrameBuffer = nullptr;
+	TileClear Rasterizer::m_tileClear(true);
 	float* Rasterizer::m_zBuffer = nullptr;
 
 	Rasterizer::Rasterizer(uint16 width, uint16 height)
@@ -19,43 +24,55 @@ namespace soft3d
 	{
 		m_width = width;
 		m_height = height;
-		if(m_frameBuffer == nullptr)
-			m_frameBuffer = new uint32[width*height*sizeof(uint32)];
+		m_tileColumns = TiledSurface::GetTileColumns(width);
+		if (m_defaultFrameBuffer == nullptr)
+		{
+			m_defaultFrameBuffer = (uint32*)TiledSurface::Allocate(width, height);
+			m_frameBuffer = m_defaultFrameBuffer;
+		}
 		if(m_zBuffer == nullptr)
-			m_zBuffer = new float[width*height*sizeof(float)];
+			m_zBuffer = (float*)TiledSurface::Allocate(width, height);
+		m_tileClear.Resize(width, height);
+		//one entry per block column at a shift of 1, coarser rates use a prefix of it
+		CoarseSample none = { 0, 0, 0 };
+		m_coarseSamples.resize((width >> 1) + 1, none);
 	}
 
 
 	Rasterizer::~Rasterizer()
 	{
-		if (m_frameBuffer)
+		if (m_defaultFrameBuffer)
 		{
-			delete m_frameBuffer;
+			TiledSurface::Free(m_defaultFrameBuffer);
+			m_defaultFrameBuffer = nullptr;
 			m_frameBuffer = nullptr;
 		}
 		if (m_zBuffer)
 		{
-			delete m_zBuffer;
+			TiledSurface::Free(m_zBuffer);
 			m_zBuffer = nullptr;
 		}
 	}
 
-	uint32* Rasterizer::GetFBPixelPtr(uint16 x, uint16 y)
+	void Rasterizer::Resize(uint16 width, uint16 height)
 	{
-		y = 599 - y;//µߵ
-		if (x > m_width || y > m_height)
-			return nullptr;
+		m_width = width;
+		m_height = height;
+		m_tileColumns = TiledSurface::GetTileColumns(width);
+		m_tileClear.Resize(width, height);
+	}
 
-		int index = y * m_width + x;
-		if (index >= (uint32)m_width * m_height)
+	//both buffers are tiled with y up, Detile flips the rows when the frame is presented
+	uint32* Rasterizer::GetFBPixelPtr(uint16 x, uint16 y)
+	{
+		if (x >= m_width || y >= m_height)
 			return nullptr;
-		return &(m_frameBuffer[index]);
+		return &(m_frameBuffer[TiledSurface::Offset(x, y, m_tileColumns)]);
 	}
 
 	int Rasterizer::DrawPixel(uint16 x, uint16 y, uint32 color, uint16 size)
 	{
-		y = 599 - y;//µߵ
-		if (x > m_width || y > m_height)
+		if (x >= m_width || y >= m_height)
 			return -1;
 		if (size > 100 || size < 1)
 			size = 1;
@@ -63,45 +80,48 @@ namespace soft3d
 		for (uint16 i = 0; i < size; i++)
 		{
 			for (uint16 j = 0; j < size; j++)
-				SetFrameBuffer((y + j - size / 2) * m_width + x + i - size / 2, color);
+				SetFrameBuffer(x + i - size / 2, y + j - size / 2, color);
 		}
 		return 0;
 	}
 
-	void Rasterizer::SetFrameBuffer(uint32 index, uint32 value)
+	void Rasterizer::SetFrameBuffer(uint32 x, uint32 y, uint32 value)
 	{
-		if (index >= (uint32)m_width * m_height)
+		if (x >= m_width || y >= m_height)
 			return;
-		m_frameBuffer[index] = value;
+		m_frameBuffer[TiledSurface::Offset(x, y, m_tileColumns)] = value;
 	}
 
 	void Rasterizer::SetZBufferV(uint32 x, uint32 y, float value)
 	{
-		y = m_height - 1 - y;//µߵ
-		if (x > m_width || y > m_height)
+		if (x >= m_width || y >= m_height)
 			return;
-		int index = y * m_width + x;
-		m_zBuffer[index] = value;
+		m_zBuffer[TiledSurface::Offset(x, y, m_tileColumns)] = value;
 	}
 
 	float Rasterizer::GetZBufferV(uint32 x, uint32 y)
 	{
-		y = m_height - 1 - y;//µߵ
-		if (x > m_width || y > m_height)
+		if (x >= m_width || y >= m_height)
 			return 0.0f;
-		int index = y * m_width + x;
-		return m_zBuffer[index];
+		return m_zBuffer[TiledSurface::Offset(x, y, m_tileColumns)];
 	}
 
 	int Rasterizer::Clear(uint32 color)
 	{
-		memset(m_frameBuffer, color, m_width * m_height * sizeof(uint32));
-		memset(m_zBuffer, 0, m_width* m_height* sizeof(float));
+		m_tileClear.Clear(m_frameBuffer, m_zBuffer, color);
+		return 0;
+	}
+
+	int Rasterizer::ClearTiles(const TileGrid& tiles, uint32 color)
+	{
+		m_tileClear.Clear(m_frameBuffer, m_zBuffer, tiles, color);
 		return 0;
 	}
 
 	void Rasterizer::Fragment(const VS_OUT* vo0, const VS_OUT* vo1, uint32 x, uint32 y, float ratio)
 	{
+		if (m_tileMask != nullptr && (x >= m_width || y >= m_height || !m_tileMask->Test(x >> TileGrid::TILE_SHIFT, y >> TileGrid::TILE_SHIFT)))
+			return;
 		m_fp.fs_in.Interpolate(vo0, vo1, ratio, 1.0f - ratio);
 		m_fp.fs_in.rhw += 0.001f;
 		if (m_fp.fs_in.rhw < GetZBufferV(x, y))
@@ -122,18 +142,42 @@ namespace soft3d
 		if (m_fp.fs_in.InterpolateRHW(vo0, vo1, vo2, ratio0, ratio1, ratio2) < GetZBufferV(x, y))
 			return;
 
+		//the first pixel of a block that passes the depth test is shaded for all of it
+		CoarseSample* sample = nullptr;
+		if (m_shadingShift != 0)
+		{
+			sample = &m_coarseSamples[x >> m_shadingShift];
+			if (sample->triangle == m_triangleSerial && sample->row == (y >> m_shadingShift))
+			{
+				uint32* pixel = GetFBPixelPtr(x, y);
+				if (pixel == nullptr)
+					return;
+				*pixel = sample->color;
+				SetZBufferV(x, y, m_fp.fs_in.rhw);
+				return;
+			}
+		}
+
 		m_fp.fs_in.Interpolate(vo0, vo1, vo2, ratio0, ratio1, ratio2);
 
 		m_fp.tex = Soft3dPipeline::Instance()->CurrentTex();
+		if (m_fp.tex != nullptr && m_fp.tex->UseMipmap())
+			m_fp.fs_in.InterpolateUVDeriv(vo0, vo1, vo2, x, y);
 
 		m_fp.out_color = GetFBPixelPtr(x, y);
 		if (m_fp.out_color == nullptr)
 			return;
 		m_fp.Process();
 		SetZBufferV(x, y, m_fp.fs_in.rhw);
+		if (sample != nullptr)
+		{
+			sample->triangle = m_triangleSerial;
+			sample->row = y >> m_shadingShift;
+			sample->color = *m_fp.out_color;
+		}
 	}
 
-	void Rasterizer::BresenhamLine(const VS_OUT* vo0, const VS_OUT* vo1)
+	void Rasterizer::BresenhamLine(const VS_OUT* vo0, const VS_OUT* vo1, const ClipRect& clip)
 	{
 		int x0 = vo0->pos[0];
 		int y0 = vo0->pos[1];
@@ -149,6 +193,7 @@ namespace soft3d
 		if (y1 < 0 || y1 > m_height)
 			return;
 
+		m_tileClear.Touch(std::min(x0, x1), std::min(y0, y1), std::max(x0, x1), std::max(y0, y1));
 		//DrawPixel(x0, y0, (uint32)(vo0->color), 5);
 
 		int x, y, dx, dy;
@@ -162,7 +207,8 @@ namespace soft3d
 			for (int i = 0; i <= abs(dx); i++)
 			{
 				float ratio = (x1 - x) / (float)dx;
-				Fragment(vo0, vo1, x, y, ratio);
+				if (clip.Contains(x, y))
+					Fragment(vo0, vo1, x, y, ratio);
 				x = dx > 0 ? x + 1 : x - 1;
 				e += 2 * abs(dy);
 				if (e >= 0)
@@ -178,7 +224,8 @@ namespace soft3d
 			for (int i = 0; i <= abs(dy); i++)
 			{
 				float ratio = (y1 - y) / (float)dy;
-				Fragment(vo0, vo1, x, y, ratio);
+				if (clip.Contains(x, y))
+					Fragment(vo0, vo1, x, y, ratio);
 				y = dy > 0 ? y + 1 : y - 1;
 				e += 2 * abs(dx);
 				if (e >= 0)
@@ -190,7 +237,7 @@ namespace soft3d
 		}
 	}
 
-	void Rasterizer::Triangle(const VS_OUT* vo0, const VS_OUT* vo1, const VS_OUT* vo2)
+	void Rasterizer::Triangle(const VS_OUT* vo0, const VS_OUT* vo1, const VS_OUT* vo2, const ClipRect& clip)
 	{
 		float fx1 = vo0->pos[0] + 0.5f;
 		float fy1 = vo0->pos[1] + 0.5f;
@@ -223,35 +270,59 @@ namespace soft3d
 		float C2 = Dy23 * fx2 - Dx23 * fy2;
 		float C3 = Dy31 * fx3 - Dx31 * fy3;
 
+		//the scan stays inside the clip rect and the screen, and only the tiles it reaches are cleared
+		int startx = std::max(std::max(minx, clip.minx), 0);
+		int starty = std::max(std::max(miny, clip.miny), 0);
+		maxx = std::min(std::min(maxx, clip.maxx), m_width - 1);
+		maxy = std::min(std::min(maxy, clip.maxy), m_height - 1);
+		if (startx > maxx || starty > maxy)
+			return;
+		m_tileClear.Touch(startx, starty, maxx, maxy);
+
+		const QualityKnobs& quality = Soft3dPipeline::Instance()->CurrentQuality();
+		m_fp.quality = quality;
+		assert(quality.shadingShift <= QualityKnobs::MAX_SHADING_SHIFT);
+		m_shadingShift = std::min<uint32>(quality.shadingShift, QualityKnobs::MAX_SHADING_SHIFT);
+		m_triangleSerial++;
+
 		float Cy1 = C1 + Dx12 * miny - Dy12 * minx;
 		float Cy2 = C2 + Dx23 * miny - Dy23 * minx;
 		float Cy3 = C3 + Dx31 * miny - Dy31 * minx;
 
-		int y = miny;
-		if (miny < 0)
+		int y = starty;
+		if (starty > miny)
 		{
-			int n = 0 - miny;
+			int n = starty - miny;
 			Cy1 += Dx12 * n;
 			Cy2 += Dx23 * n;
 			Cy3 += Dx31 * n;
-			y = 0;
 		}
-		for (; y <= maxy && y < m_height; y++)
+		for (; y <= maxy; y++)
 		{
 			float Cx1 = Cy1;
 			float Cx2 = Cy2;
 			float Cx3 = Cy3;
-			int x = minx;
-			if (minx < 0)
+			int x = startx;
+			if (startx > minx)
 			{
-				int n = 0 - minx;
+				int n = startx - minx;
 				Cx1 -= Dy12 * n;
 				Cx2 -= Dy23 * n;
 				Cx3 -= Dy31 * n;
-				x = 0;
 			}
-			for (; x <= maxx && x < m_width; x++)
+			uint32 tileRow = y >> TileGrid::TILE_SHIFT;
+			for (; x <= maxx; x++)
 			{
+				if (m_tileMask != nullptr && !m_tileMask->Test(x >> TileGrid::TILE_SHIFT, tileRow))
+				{
+					//jump to the first pixel of the next tile
+					int n = ((x | (TileGrid::TILE_SIZE - 1)) + 1) - x;
+					Cx1 -= Dy12 * n;
+					Cx2 -= Dy23 * n;
+					Cx3 -= Dy31 * n;
+					x += n - 1;
+					continue;
+				}
 				if (Cx1 <= 0 && Cx2 <= 0 && Cx3 <= 0)
 				{
 					float ratio1 = ((y - y3)*(x1 - x3) - (y1 - y3)*(x - x3)) / (float)((y2 - y3)*(x1 - x3) - (y1 - y3)*(x2 - x3));
@@ -280,6 +351,16 @@ namespace soft3d
 		m_tasks.push_back(rt);
 	}
 
+	void Rasterizer::AddTasks(std::vector<RasterizerTask>& tasks)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		if (m_tasks.empty())
+			m_tasks.swap(tasks);
+		else
+			m_tasks.insert(m_tasks.end(), tasks.begin(), tasks.end());
+		tasks.clear();
+	}
+
 	void Rasterizer::EndTasks()
 	{
 		m_taskFlag = false;
@@ -296,11 +377,11 @@ namespace soft3d
 				RasterizerTask& task = m_tasks_doing.back();
 				if (task.m_vo[2] == nullptr)
 				{
-					BresenhamLine(task.m_vo[0], task.m_vo[1]);
+					BresenhamLine(task.m_vo[0], task.m_vo[1], task.m_clip);
 				}
 				else
 				{
-					Triangle(task.m_vo[0], task.m_vo[1], task.m_vo[2]);
+					Triangle(task.m_vo[0], task.m_vo[1], task.m_vo[2], task.m_clip);
 				}
 				m_tasks_doing.pop_back();
 			}
@@ -1,27 +1,13 @@
 #pragma once
 #include <boost/noncopyable.hpp>
 #include <boost/thread.hpp>
+#include "RasterizerTask.h"
+#include "TileClear.h"
 
 namespace soft3d
 {
 	struct PipeLineData;
-
-	struct RasterizerTask
-	{
-		RasterizerTask(VS_OUT* vo0, VS_OUT* vo1) {
-			m_vo[0] = vo0;
-			m_vo[1] = vo1;
-			m_vo[2] = nullptr;
-		}
-		RasterizerTask(VS_OUT* vo0, VS_OUT* vo1, VS_OUT* vo2) {
-			m_vo[0] = vo0;
-			m_vo[1] = vo1;
-			m_vo[2] = vo2;
-		}
-		~RasterizerTask() = default;
-
-		VS_OUT* m_vo[3];
-	};
+	class TileGrid;
 
 	class Rasterizer : public boost::noncopyable
 	{
@@ -29,25 +15,48 @@ namespace soft3d
 		Rasterizer(uint16 width, uint16 height);
 		virtual ~Rasterizer();
 
+		//renders into the lower left width * height of the buffers, no larger than the size it was created with;
+		//call between frames
+		void Resize(uint16 width, uint16 height);
+
+		//both only flag tiles of the bound frame buffer, a tile is cleared when first drawn into
 		int Clear(uint32 color);
+		//clears color and depth of the flagged tiles only, the rest of the frame is kept
+		int ClearTiles(const TileGrid& tiles, uint32 color);
+		//fills the tiles no task drew into, once every rasterizer is done and before the frame is read
+		static void ResolveClears() {
+			m_tileClear.Resolve();
+		}
+		//fragments outside the flagged tiles are dropped, null draws everywhere; the grid must outlive the tasks
+		void SetTileMask(const TileGrid* tiles) {
+			m_tileMask = tiles;
+		}
 		int DrawPixel(uint16 x, uint16 y, uint32 color, uint16 size = 1);
 		uint32* GetFBPixelPtr(uint16 x, uint16 y);
 
 		void BeginTasks();
 		void AddTask(RasterizerTask& rt);
+		//moves a whole bin in at once, tasks is left empty
+		void AddTasks(std::vector<RasterizerTask>& tasks);
 		void EndTasks();
 
 		void Fragment(const VS_OUT* vo0, const VS_OUT* vo1, uint32 x, uint32 y, float ratio);
 		void Fragment(const VS_OUT* vo0, const VS_OUT* vo1, const VS_OUT* vo2, uint32 x, uint32 y, float ratio0, float ratio1);
-		void BresenhamLine(const VS_OUT* vo0, const VS_OUT* vo1);
-		void Triangle(const VS_OUT* vo0, const VS_OUT* vo1, const VS_OUT* vo2);
+		//both draw only inside clip
+		void BresenhamLine(const VS_OUT* vo0, const VS_OUT* vo1, const ClipRect& clip = ClipRect::Unbounded());
+		void Triangle(const VS_OUT* vo0, const VS_OUT* vo1, const VS_OUT* vo2, const ClipRect& clip = ClipRect::Unbounded());
 
+		//in the TiledSurface layout
 		static const uint32* GetFrameBuffer() {
 			return m_frameBuffer;
 		}
+		//renders into buffer from now on, TiledSurface::GetPixelCount pixels owned by the caller; null goes back to the own one
+		static void BindFrameBuffer(uint32* buffer) {
+			m_frameBuffer = buffer != nullptr ? buffer : m_defaultFrameBuffer;
+		}
 
 	protected:
-		void SetFrameBuffer(uint32 index, uint32 value);
+		void SetFrameBuffer(uint32 x, uint32 y, uint32 value);
 		void SetZBufferV(uint32 x, uint32 y, float value);
 		float GetZBufferV(uint32 x, uint32 y);
 
@@ -58,9 +67,25 @@ namespace soft3d
 
 		uint16 m_width;
 		uint16 m_height;
+		uint32 m_tileColumns;
 		static uint32* m_frameBuffer;
+		static uint32* m_defaultFrameBuffer;
+		static TileClear m_tileClear;
 		static float* m_zBuffer;
 		VertexBufferObject::RENDER_MODE m_mode = VertexBufferObject::RENDER_TRIANGLE;
+		const TileGrid* m_tileMask = nullptr;
+
+		//colors shaded for the blocks of the current triangle by block column, shading rates above 1 only;
+		//a triangle walks its rows bottom up so one row of blocks is enough
+		struct CoarseSample
+		{
+			uint32 triangle;
+			uint32 row;
+			uint32 color;
+		};
+		std::vector<CoarseSample> m_coarseSamples;
+		uint32 m_triangleSerial = 0;
+		uint32 m_shadingShift = 0;
 
 	private:
 		boost::thread m_workThread;
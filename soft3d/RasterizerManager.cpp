@@ -15,11 +15,12 @@ namespace soft3d
 		m_width = width;
 		m_height = height;
 		if (m_frameBuffer == nullptr)
-			m_frameBuffer = new uint32[width*height*sizeof(uint32)];
+			m_frameBuffer = new uint32[width*height];
 		if (m_zBuffer == nullptr)
-			m_zBuffer = new float[width*height*sizeof(float)];
+			m_zBuffer = new float[width*height];
 		if (m_fragmentData == nullptr)
-			m_fragmentData = new FragmentData[width*height*sizeof(FragmentData)];
+			m_fragmentData = new FragmentData[width*height];
+		m_tileClear.Resize(width, height);
 
 		m_thread_ratio = 0.7f;
 		m_thread_ratio = vmath::clamp<float>(m_thread_ratio, 0.0f, 0.99f);
@@ -90,9 +91,9 @@ namespace soft3d
 
 	uint32* RasterizerManager::GetFBPixelPtr(uint16 x, uint16 y)
 	{
-		y = 599 - y;//µߵ
-		if (x > m_width || y > m_height)
+		if (x >= m_width || y >= m_height)
 			return nullptr;
+		y = m_height - 1 - y;//µߵ
 
 		int index = y * m_width + x;
 		if (index >= (uint32)m_width * m_height)
@@ -102,9 +103,9 @@ namespace soft3d
 
 	int RasterizerManager::DrawPixel(uint16 x, uint16 y, uint32 color, uint16 size)
 	{
-		y = 599 - y;//µߵ
-		if (x > m_width || y > m_height)
+		if (x >= m_width || y >= m_height)
 			return -1;
+		y = m_height - 1 - y;//µߵ
 		if (size > 100 || size < 1)
 			size = 1;
 
@@ -143,8 +144,7 @@ namespace soft3d
 
 	int RasterizerManager::Clear(uint32 color)
 	{
-		memset(m_frameBuffer, color, m_width * m_height * sizeof(uint32));
-		memset(m_zBuffer, 0, m_width* m_height* sizeof(float));
+		m_tileClear.Clear(m_frameBuffer, m_zBuffer, color);
 		return 0;
 	}
 
@@ -172,6 +172,8 @@ namespace soft3d
 
 		fp->fs_in.Interpolate(vo0, vo1, vo2, ratio0, ratio1, ratio2);
 		fp->tex = Soft3dPipeline::Instance()->CurrentTex();
+		if (fp->tex != nullptr && fp->tex->UseMipmap())
+			fp->fs_in.InterpolateUVDeriv(vo0, vo1, vo2, x, y);
 
 		fp->out_color = GetFBPixelPtr(x, y);
 		if (fp->out_color == nullptr)
@@ -180,7 +182,7 @@ namespace soft3d
 		SetZBufferV(x, y, fp->fs_in.rhw);
 	}
 
-	void RasterizerManager::BresenhamLine(const VS_OUT* vo0, const VS_OUT* vo1)
+	void RasterizerManager::BresenhamLine(const VS_OUT* vo0, const VS_OUT* vo1, const ClipRect& clip)
 	{
 		int x0 = vo0->pos[0];
 		int y0 = vo0->pos[1];
@@ -195,6 +197,8 @@ namespace soft3d
 			return;
 		if (y1 < 0 || y1 > m_height)
 			return;
+		//cleared here on the rasterize thread, before any fragment of the line is queued
+		m_tileClear.Touch(std::min(x0, x1), std::min(y0, y1), std::max(x0, x1), std::max(y0, y1));
 
 		//DrawPixel(x0, y0, (uint32)(vo0->color), 5);
 
@@ -209,8 +213,11 @@ namespace soft3d
 			for (int i = 0; i <= abs(dx); i++)
 			{
 				float ratio = (x1 - x) / (float)dx;
-				int id = y * m_width + x;
-				AddFragTask(id, vo0, vo1, nullptr, ratio, 0.0f);
+				if (clip.Contains(x, y))
+				{
+					int id = y * m_width + x;
+					AddFragTask(id, vo0, vo1, nullptr, ratio, 0.0f);
+				}
 				//FragmentProcessor fp;
 				//Fragment(&fp, vo0, vo1, x, y, ratio);
 				x = dx > 0 ? x + 1 : x - 1;
@@ -228,8 +235,11 @@ namespace soft3d
 			for (int i = 0; i <= abs(dy); i++)
 			{
 				float ratio = (y1 - y) / (float)dy;
-				int id = y * m_width + x;
-				AddFragTask(id, vo0, vo1, nullptr, ratio, 0.0f);
+				if (clip.Contains(x, y))
+				{
+					int id = y * m_width + x;
+					AddFragTask(id, vo0, vo1, nullptr, ratio, 0.0f);
+				}
 				//FragmentProcessor fp;
 				//Fragment(&fp, vo0, vo1, x, y, ratio);
 				y = dy > 0 ? y + 1 : y - 1;
@@ -243,7 +253,7 @@ namespace soft3d
 		}
 	}
 
-	void RasterizerManager::Triangle(const VS_OUT* vo0, const VS_OUT* vo1, const VS_OUT* vo2)
+	void RasterizerManager::Triangle(const VS_OUT* vo0, const VS_OUT* vo1, const VS_OUT* vo2, const ClipRect& clip)
 	{
 		double fx1 = vo0->pos[0] + 0.5f;
 		double fy1 = vo0->pos[1] + 0.5f;
@@ -272,6 +282,15 @@ namespace soft3d
 		int miny = vmath::min<int>(fy1, fy2, fy3);
 		int maxy = vmath::max<int>(fy1, fy2, fy3);
 
+		//the scan stays inside the clip rect and the screen, and only the tiles it reaches are cleared
+		int startx = std::max(std::max(minx, clip.minx), 0);
+		int starty = std::max(std::max(miny, clip.miny), 0);
+		maxx = std::min(std::min(maxx, clip.maxx), m_width - 1);
+		maxy = std::min(std::min(maxy, clip.maxy), m_height - 1);
+		if (startx > maxx || starty > maxy)
+			return;
+		m_tileClear.Touch(startx, starty, maxx, maxy);
+
 		double C1 = Dy12 * fx1 - Dx12 * fy1;
 		double C2 = Dy23 * fx2 - Dx23 * fy2;
 		double C3 = Dy31 * fx3 - Dx31 * fy3;
@@ -280,30 +299,28 @@ namespace soft3d
 		float Cy2 = C2 + Dx23 * miny - Dy23 * minx;
 		float Cy3 = C3 + Dx31 * miny - Dy31 * minx;
 
-		int y = miny;
-		if (miny < 0)
+		int y = starty;
+		if (starty > miny)
 		{
-			int n = 0 - miny;
+			int n = starty - miny;
 			Cy1 += Dx12 * n;
 			Cy2 += Dx23 * n;
 			Cy3 += Dx31 * n;
-			y = 0;
 		}
-		for (; y <= maxy && y < m_height; y++)
+		for (; y <= maxy; y++)
 		{
 			float Cx1 = Cy1;
 			float Cx2 = Cy2;
 			float Cx3 = Cy3;
-			int x = minx;
-			if (minx < 0)
+			int x = startx;
+			if (startx > minx)
 			{
-				int n = 0 - minx;
+				int n = startx - minx;
 				Cx1 -= Dy12 * n;
 				Cx2 -= Dy23 * n;
 				Cx3 -= Dy31 * n;
-				x = 0;
 			}
-			for (; x <= maxx && x < m_width; x++)
+			for (; x <= maxx; x++)
 			{
 				if (Cx1 <= 0 && Cx2 <= 0 && Cx3 <= 0)
 				{
@@ -322,13 +339,13 @@ namespace soft3d
 		}
 	}
 
-	void RasterizerManager::AddRasterizeTask(VS_OUT* vo0, VS_OUT* vo1, VS_OUT* vo2)
+	void RasterizerManager::AddRasterizeTask(VS_OUT* vo0, VS_OUT* vo1, VS_OUT* vo2, const ClipRect& clip)
 	{
 		static long index = 0;
 		long id = index%m_rasterizeThreadCount;
 		index++;
 		boost::mutex::scoped_lock lock(m_rasterizeThreads[id]->m_swap_mutex);
-		m_rasterizeThreads[id]->m_task.push_back(RasterizeData(vo0, vo1, vo2));
+		m_rasterizeThreads[id]->m_task.push_back(RasterizeData(vo0, vo1, vo2, clip));
 	}
 
 	void RasterizerManager::RasterizeThreadFun(int id)
@@ -341,11 +358,11 @@ namespace soft3d
 				RasterizeData& data = rt->m_task_doing[rt->m_doing_index];
 				if (data.m_vo[2] == nullptr)
 				{
-					BresenhamLine(data.m_vo[0], data.m_vo[1]);
+					BresenhamLine(data.m_vo[0], data.m_vo[1], data.m_clip);
 				}
 				else
 				{
-					Triangle(data.m_vo[0], data.m_vo[1], data.m_vo[2]);
+					Triangle(data.m_vo[0], data.m_vo[1], data.m_vo[2], data.m_clip);
 				}
 
 				rt->m_doing_index++;
@@ -424,6 +441,7 @@ namespace soft3d
 			m_fragThreads[i]->m_async_mutex.lock();
 			m_fragThreads[i]->m_async_mutex.unlock();
 		}
+		m_tileClear.Resolve();
 	}
 
 	void RasterizerManager::FragThreadFun(int id)
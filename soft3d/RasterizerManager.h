@@ -1,4 +1,6 @@
 #pragma once
+#include "TileClear.h"
+#include "RasterizerTask.h"
 
 namespace soft3d
 {
@@ -27,18 +29,21 @@ namespace soft3d
 
 	struct RasterizeData
 	{
-		RasterizeData(VS_OUT* vo0, VS_OUT* vo1) {
+		RasterizeData(VS_OUT* vo0, VS_OUT* vo1, const ClipRect& clip = ClipRect::Unbounded()) {
 			m_vo[0] = vo0;
 			m_vo[1] = vo1;
 			m_vo[2] = nullptr;
+			m_clip = clip;
 		}
-		RasterizeData(VS_OUT* vo0, VS_OUT* vo1, VS_OUT* vo2) {
+		RasterizeData(VS_OUT* vo0, VS_OUT* vo1, VS_OUT* vo2, const ClipRect& clip = ClipRect::Unbounded()) {
 			m_vo[0] = vo0;
 			m_vo[1] = vo1;
 			m_vo[2] = vo2;
+			m_clip = clip;
 		}
 		~RasterizeData() = default;
 		const VS_OUT* m_vo[3];
+		ClipRect m_clip;
 	};
 
 	struct RasterizeThread
@@ -58,6 +63,7 @@ namespace soft3d
 		RasterizerManager(uint16 width, uint16 height);
 		~RasterizerManager();
 
+		//only flags tiles, they are cleared when first drawn into or at the end of EndTask
 		int Clear(uint32 color);
 		int DrawPixel(uint16 x, uint16 y, uint32 color, uint16 size = 1);
 		uint32* GetFBPixelPtr(uint16 x, uint16 y);
@@ -65,14 +71,16 @@ namespace soft3d
 		void Fragment(FragmentProcessor* fp, const VS_OUT* vo0, const VS_OUT* vo1, uint32 x, uint32 y, float ratio);
 		void Fragment(FragmentProcessor* fp, const VS_OUT* vo0, const VS_OUT* vo1, const VS_OUT* vo2, uint32 x, uint32 y, float ratio0, float ratio1);
 
-		void BresenhamLine(const VS_OUT* vo0, const VS_OUT* vo1);
-		void Triangle(const VS_OUT* vo0, const VS_OUT* vo1, const VS_OUT* vo2);
+		//both draw only inside clip
+		void BresenhamLine(const VS_OUT* vo0, const VS_OUT* vo1, const ClipRect& clip = ClipRect::Unbounded());
+		void Triangle(const VS_OUT* vo0, const VS_OUT* vo1, const VS_OUT* vo2, const ClipRect& clip = ClipRect::Unbounded());
 
 		const uint32* GetFrameBuffer() {
 			return m_frameBuffer;
 		}
 
-		void AddRasterizeTask(VS_OUT* vo0, VS_OUT* vo1, VS_OUT* vo2);
+		//a line when vo2 is null
+		void AddRasterizeTask(VS_OUT* vo0, VS_OUT* vo1, VS_OUT* vo2, const ClipRect& clip = ClipRect::Unbounded());
 		void AddFragTask(int id, const VS_OUT* vo0, const VS_OUT* vo1, const VS_OUT* vo2, float ratio0, float ratio1);
 		void BeginTask();
 		void EndTask();
@@ -93,6 +101,7 @@ namespace soft3d
 		uint32* m_frameBuffer = nullptr;
 		float* m_zBuffer = nullptr;
 		FragmentData* m_fragmentData = nullptr;
+		TileClear m_tileClear;
 
 		int m_fragThreadCount = 1;
 		int m_rasterizeThreadCount = 1;
@@ -0,0 +1,61 @@
+#pragma once
+#include <climits>
+#include <algorithm>
+
+namespace soft3d
+{
+
+	//inclusive pixel rect in rasterizer coordinates (y up) a draw is confined to, from its viewport and scissor
+	struct ClipRect
+	{
+		int minx;
+		int miny;
+		int maxx;
+		int maxy;
+
+		static inline ClipRect Unbounded() {
+			ClipRect clip = { INT_MIN, INT_MIN, INT_MAX, INT_MAX };
+			return clip;
+		}
+		inline bool Contains(int x, int y) const {
+			return x >= minx && x <= maxx && y >= miny && y <= maxy;
+		}
+		//shrinks this one to its overlap with an inclusive rect
+		inline void Intersect(const int* rect) {
+			minx = std::max(minx, rect[0]);
+			miny = std::max(miny, rect[1]);
+			maxx = std::min(maxx, rect[2]);
+			maxy = std::min(maxy, rect[3]);
+		}
+		//clamps an inclusive rect to this one, false when nothing is left
+		inline bool Clip(int* rect) const {
+			rect[0] = std::max(rect[0], minx);
+			rect[1] = std::max(rect[1], miny);
+			rect[2] = std::min(rect[2], maxx);
+			rect[3] = std::min(rect[3], maxy);
+			return rect[0] <= rect[2] && rect[1] <= rect[3];
+		}
+	};
+
+	//a line when m_vo[2] is null, a ccw triangle otherwise
+	struct RasterizerTask
+	{
+		RasterizerTask(VS_OUT* vo0, VS_OUT* vo1, const ClipRect& clip = ClipRect::Unbounded()) {
+			m_vo[0] = vo0;
+			m_vo[1] = vo1;
+			m_vo[2] = nullptr;
+			m_clip = clip;
+		}
+		RasterizerTask(VS_OUT* vo0, VS_OUT* vo1, VS_OUT* vo2, const ClipRect& clip = ClipRect::Unbounded()) {
+			m_vo[0] = vo0;
+			m_vo[1] = vo1;
+			m_vo[2] = vo2;
+			m_clip = clip;
+		}
+		~RasterizerTask() = default;
+
+		VS_OUT* m_vo[3];
+		ClipRect m_clip;
+	};
+
+}
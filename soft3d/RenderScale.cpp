@@ -0,0 +1,49 @@
+#include "soft3d.h"
+#include "RenderScale.h"
+
+namespace soft3d
+{
+
+	RenderScale::RenderScale() :
+		m_targetMs(0.0f),
+		m_minScale(0.5f),
+		m_maxScale(1.0f),
+		m_scale(1.0f),
+		m_averageMs(0.0f),
+		m_step(STEPS)
+	{
+	}
+
+	void RenderScale::SetTarget(float targetMs, float minScale, float maxScale)
+	{
+		m_targetMs = std::max(targetMs, 0.0f);
+		m_maxScale = std::max(std::min(maxScale, 1.0f), 1.0f / STEPS);
+		m_minScale = std::max(std::min(minScale, m_maxScale), 1.0f / STEPS);
+		m_scale = m_maxScale;
+		m_averageMs = 0.0f;
+		m_step = IsEnabled() ? (int)(m_scale * STEPS) : STEPS;
+	}
+
+	float RenderScale::Update(float frameMs)
+	{
+		if (!IsEnabled() || frameMs <= 0.0f)
+			return GetScale();
+		m_averageMs = m_averageMs == 0.0f ? frameMs : m_averageMs * 0.75f + frameMs * 0.25f;
+		//a slow frame drops the scale at once, going back up is left to the average,
+		//which never lowers it while the frames themselves are in time
+		float ratio = frameMs > m_targetMs ? m_targetMs / frameMs : std::max(m_targetMs / m_averageMs, 1.0f);
+		//within 5% of the target the size is left alone, it would only oscillate around it
+		if (ratio < 0.95f || ratio > 1.05f)
+		{
+			float scale = m_scale * sqrtf(ratio);
+			//down fast to keep the frame pacing, up slowly so one cheap frame doesn't cause the next slow one
+			scale = std::min(std::max(scale, m_scale * 0.8f), m_scale * 1.05f);
+			m_scale = std::min(std::max(scale, m_minScale), m_maxScale);
+		}
+		int step = (int)(m_scale * STEPS + 0.5f);
+		step = std::min(std::max(step, (int)ceilf(m_minScale * STEPS)), (int)(m_maxScale * STEPS));
+		m_step = std::max(step, 1);
+		return GetScale();
+	}
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+namespace soft3d
+{
+
+	//dynamic resolution governor: picks the scale of the next frame's render size from the measured frame times;
+	//a frame's cost is taken as proportional to its pixels, so the scale moves by sqrt(target / measured)
+	class RenderScale
+	{
+	public:
+		RenderScale();
+
+		//targetMs of 0 turns it off and goes back to a scale of 1
+		void SetTarget(float targetMs, float minScale = 0.5f, float maxScale = 1.0f);
+		inline bool IsEnabled() const {
+			return m_targetMs > 0.0f;
+		}
+
+		//feeds the time of the last frame, returns the scale of the next one
+		float Update(float frameMs);
+		//in steps of 1 / STEPS so small corrections don't change the render size every frame
+		inline float GetScale() const {
+			return m_step / (float)STEPS;
+		}
+		inline float GetTarget() const {
+			return m_targetMs;
+		}
+
+	private:
+		enum
+		{
+			STEPS = 32,
+		};
+
+		float m_targetMs;
+		float m_minScale;
+		float m_maxScale;
+		float m_scale;
+		float m_averageMs;//smoothed frame time, 0 until the first sample
+		int m_step;
+	};
+
+}
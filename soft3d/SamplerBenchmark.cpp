@@ -0,0 +1,103 @@
+#include "soft3d.h"
+#include "SamplerBenchmark.h"
+#include <chrono>
+#include <vector>
+
+using namespace vmath;
+
+namespace soft3d
+{
+	uint32 SamplerBenchmark::s_sink = 0;
+
+	double SamplerBenchmark::Run(const Texture& tex, PATTERN pattern, uint16 width, uint16 height, bool wide)
+	{
+		const float c = 0.70710678f;
+		const float invW = 1.0f / width;
+		const float invH = 1.0f / height;
+		uint32 sum = 0;
+		vec2 quad[4];
+		Color colors[4];
+		auto begin = std::chrono::high_resolution_clock::now();
+		for (uint32 y = 0; y < height; y++)
+		{
+			for (uint32 x = 0; x < width; x++)
+			{
+				vec2 uv;
+				switch (pattern)
+				{
+				case PATTERN_SCANLINE:
+					uv = vec2((x + 0.5f) * invW, (y + 0.5f) * invH);
+					break;
+				case PATTERN_ROTATED:
+				{
+					//scaled by 1/sqrt(2) so the rotated footprint stays inside [0,1]
+					float dx = (x + 0.5f) * invW - 0.5f;
+					float dy = (y + 0.5f) * invH - 0.5f;
+					uv = vec2(0.5f + (dx * c - dy * c) * c, 0.5f + (dx * c + dy * c) * c);
+					break;
+				}
+				case PATTERN_MINIFIED:
+				default:
+					uv = vec2(((x * 4) % width + 0.5f) * invW, ((y * 4) % height + 0.5f) * invH);
+					break;
+				}
+				if (wide)
+				{
+					quad[x & 3] = uv;
+					if ((x & 3) == 3)
+					{
+						tex.Sampler2D_bilinear4(quad, colors);
+						sum += colors[0] + colors[1] + colors[2] + colors[3];
+					}
+				}
+				else
+				{
+					sum += tex.Sampler2D(&uv);
+				}
+			}
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		s_sink += sum;
+		return std::chrono::duration<double, std::milli>(end - begin).count();
+	}
+
+	void SamplerBenchmark::Report(FILE* out, uint16 texSize, int iterations)
+	{
+		std::vector<uint32> buf(texSize * texSize);
+		for (uint32 y = 0; y < texSize; y++)
+			for (uint32 x = 0; x < texSize; x++)
+				buf[x + y * texSize] = 0xff000000 | ((x ^ y) & 0xff) << 16 | (x & 0xff) << 8 | (y & 0xff);
+
+		Texture linear;
+		Texture tiled;
+		linear.CopyFromBuffer(&buf[0], texSize, texSize, Texture::LAYOUT_LINEAR);
+		tiled.CopyFromBuffer(&buf[0], texSize, texSize, Texture::LAYOUT_TILED);
+
+		const char* patternNames[PATTERN_COUNT] = { "scanline", "rotated45", "minified" };
+		const char* filterNames[3] = { "nearest", "bilinear", "bilinear4" };
+		Texture::FILTER_MODE filters[3] = { Texture::NEAREST, Texture::BILINEAR, Texture::BILINEAR };
+
+		fprintf(out, "sampler benchmark %dx%d texture, %d iterations\n", texSize, texSize, iterations);
+		fprintf(out, "%-10s %-10s %12s %12s %8s\n", "pattern", "filter", "linear(ms)", "tiled(ms)", "speedup");
+		for (int f = 0; f < 3; f++)
+		{
+			linear.filter_mode = filters[f];
+			tiled.filter_mode = filters[f];
+			for (int p = 0; p < PATTERN_COUNT; p++)
+			{
+				double linearMs = 0.0;
+				double tiledMs = 0.0;
+				for (int i = 0; i < iterations; i++)
+				{
+					linearMs += Run(linear, (PATTERN)p, texSize, texSize, f == 2);
+					tiledMs += Run(tiled, (PATTERN)p, texSize, texSize, f == 2);
+				}
+				linearMs /= iterations;
+				tiledMs /= iterations;
+				fprintf(out, "%-10s %-10s %12.2f %12.2f %7.2fx\n", patternNames[p], filterNames[f], linearMs, tiledMs, linearMs / tiledMs);
+			}
+		}
+		fprintf(out, "checksum %08x\n", s_sink);
+	}
+
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <stdio.h>
+#include "soft3d.h"
+
+namespace soft3d
+{
+
+	class SamplerBenchmark
+	{
+	public:
+		enum PATTERN
+		{
+			PATTERN_SCANLINE,//1:1 mapping, walking the texture row by row
+			PATTERN_ROTATED,//the same footprint rotated 45 degrees
+			PATTERN_MINIFIED,//4 texels per pixel in both directions
+			PATTERN_COUNT,
+		};
+
+		//samples width*height pixels with the given pattern and returns the elapsed milliseconds,
+		//wide uses Sampler2D_bilinear4 on groups of four pixels
+		static double Run(const Texture& tex, PATTERN pattern, uint16 width, uint16 height, bool wide = false);
+		//compares LAYOUT_LINEAR and LAYOUT_TILED on every pattern and prints a table
+		static void Report(FILE* out, uint16 texSize = 1024, int iterations = 10);
+
+	private:
+		static uint32 s_sink;
+	};
+
+}
@@ -1,6 +1,6 @@
 #include "soft3d.h"
 #include "SceneManagerBigFbx.h"
-#include "TextureLoader.h"
+#include "AssetLoader.h"
 #include <boost/bind.hpp>
 
 using namespace std;
@@ -15,27 +15,30 @@ namespace soft3d
 		m_width = width;
 		m_height = height;
 
-		m_fbx.LoadFbx("zhankuang.fbx");
-
-		shared_ptr<VertexBufferObject> vbo(new VertexBufferObject());
-		vbo->CopyVertexBuffer(m_fbx.GetVertexBuffer(), m_fbx.GetVertexCount() * 4);
-		vbo->CopyIndexBuffer(m_fbx.GetIndexBuffer(), m_fbx.GetIndexCount());
-		vbo->CopyNormalBuffer(m_fbx.GetNormalBuffer(), m_fbx.GetNormalCount() * 3);
-		vbo->CopyUVBuffer(m_fbx.GetUVBuffer(), m_fbx.GetUVCount() * 2);
-
-		//vbo->m_cullMode = VertexBufferObject::CULL_CW;
-		vbo->m_mode = VertexBufferObject::RENDER_TRIANGLE;
-		m_vbo1 = Soft3dPipeline::Instance()->SetVBO(vbo);
+		//an empty vbo and a placeholder texture keep the scene drawable until the assets arrive
+		m_vbo1 = Soft3dPipeline::Instance()->SetVBO(shared_ptr<VertexBufferObject>(new VertexBufferObject()));
+		Soft3dPipeline::Instance()->SetTexture(AssetLoader::Instance().GetPlaceholderTexture());
+		AssetLoader::Instance().LoadMeshAsync("zhankuang.fbx", boost::bind(&SceneManagerBigFbx::OnMeshLoaded, this, _1));
+		AssetLoader::Instance().LoadTextureAsync("zhankuang.png", boost::bind(&SceneManagerBigFbx::OnTextureLoaded, this, _1));
 		//vbo->m_mode = VertexBufferObject::RENDER_LINE;
 		//m_vbo2 = Soft3dPipeline::Instance()->SetVBO(vbo);
 
-		TextureLoader::Instance().LoadTexture(L"zhankuang.png");
+		Soft3dPipeline::Instance()->AddKeyboardEventCB(boost::bind(&SceneManagerBigFbx::KeyboardEventCB, this, _1));
+	}
 
-		shared_ptr<Texture> tex(new Texture());
-		tex->CopyFromBuffer(TextureLoader::Instance().GetData(), TextureLoader::Instance().GetWidth(), TextureLoader::Instance().GetHeight());
-		Soft3dPipeline::Instance()->SetTexture(tex);
+	void SceneManagerBigFbx::OnMeshLoaded(shared_ptr<VertexBufferObject> vbo)
+	{
+		if (vbo == nullptr)
+			return;
+		//vbo->m_cullMode = VertexBufferObject::CULL_CW;
+		vbo->m_mode = VertexBufferObject::RENDER_TRIANGLE;
+		Soft3dPipeline::Instance()->ReplaceVBO(m_vbo1, vbo);
+	}
 
-		Soft3dPipeline::Instance()->AddKeyboardEventCB(boost::bind(&SceneManagerBigFbx::KeyboardEventCB, this, _1));
+	void SceneManagerBigFbx::OnTextureLoaded(shared_ptr<Texture> tex)
+	{
+		if (tex != nullptr)
+			Soft3dPipeline::Instance()->SetTexture(tex);
 	}
 
 	void SceneManagerBigFbx::Update()
@@ -67,15 +70,15 @@ namespace soft3d
 			* rotate(m_y_angle, vec3(0.0f, 1.0f, 0.0f))
 			* rotate(m_z_angle, vec3(0.0f, 0.0f, 1.0f));
 
-		SetUniform(UNIFORM_MV_MATRIX, mv_matrix);
-		SetUniform(UNIFORM_PROJ_MATRIX, proj_matrix);
-		SetUniform(UNIFORM_VIEW_MATRIX, view_matrix);
-		SetUniform(UNIFORM_LIGHT_DIR, vec3(x, 0.0f, z));
+		DefaultUniforms uniforms;
+		uniforms.mv_matrix = mv_matrix;
+		uniforms.proj_matrix = proj_matrix;
+		uniforms.view_matrix = view_matrix;
+		uniforms.light_mode = DefaultUniforms::LIGHT_DIRECTIONAL;
+		uniforms.light_dir = vec3(x, 0.0f, z);
+		Soft3dPipeline::Instance()->SetUniforms(uniforms);
 		//Soft3dPipeline::Instance()->SelectVBO(m_vbo2);
-		//SetUniform(UNIFORM_MV_MATRIX, mv_matrix);
-		//SetUniform(UNIFORM_PROJ_MATRIX, proj_matrix);
-		//SetUniform(UNIFORM_VIEW_MATRIX, view_matrix);
-		//SetUniform(UNIFORM_LIGHT_DIR, vec3(x, 0.0f, z));
+		//Soft3dPipeline::Instance()->SetUniforms(uniforms);
 		
 		Soft3dPipeline::Instance()->Clear(0);
 	}
@@ -1,6 +1,5 @@
 #pragma once
 #include "SceneManager.h"
-#include "FbxLoader.h"
 
 namespace soft3d
 {
@@ -13,6 +12,8 @@ namespace soft3d
 		virtual void InitScene(soft3d::uint16 width, soft3d::uint16 height);
 		virtual void Update();
 		void KeyboardEventCB(const DIKEYBOARD dikeyboard);
+		void OnMeshLoaded(std::shared_ptr<VertexBufferObject> vbo);
+		void OnTextureLoaded(std::shared_ptr<Texture> tex);
 
 	private:
 		float m_x_angle = -90.0f;
@@ -27,8 +28,6 @@ namespace soft3d
 
 		int m_vbo1;
 		int m_vbo2;
-
-		FbxLoader m_fbx;
 	};
 
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "soft3d.h"
 #include "SceneManagerFbx.h"
-#include "TextureLoader.h"
+#include "AssetLoader.h"
+#include "FbxLoader.h"
 #include <boost/bind.hpp>
 
 using namespace std;
@@ -15,19 +16,38 @@ namespace soft3d
 		m_width = width;
 		m_height = height;
 
-		m_fbx.LoadFbx("sphere_anim.fbx");
+		FbxLoader fbx;
+		fbx.LoadFbx("sphere_anim.fbx");
+		m_animation = fbx.GetAnimation();
+		m_pose.resize(m_animation ? m_animation->GetNodeCount() : 0);
 
 		shared_ptr<VertexBufferObject> vbo(new VertexBufferObject());
-		vbo->CopyVertexBuffer(m_fbx.GetVertexBuffer(), m_fbx.GetVertexCount() * 4);
-		vbo->CopyIndexBuffer(m_fbx.GetIndexBuffer(), m_fbx.GetIndexCount());
-		vbo->CopyNormalBuffer(m_fbx.GetNormalBuffer(), m_fbx.GetNormalCount() * 3);
-		vbo->CopyUVBuffer(m_fbx.GetUVBuffer(), m_fbx.GetUVCount() * 2);
+		const vector<FbxMeshData>& meshes = fbx.GetMeshes();
+		if (!meshes.empty() && !meshes[0].boneNodes.empty())
+		{
+			//a skinned mesh is posed on the cpu every frame, the vbo views the skinned output
+			const FbxMeshData& mesh = meshes[0];
+			m_skin = shared_ptr<SkinnedMesh>(new SkinnedMesh(&mesh.vertices[0], mesh.normals.empty() ? nullptr : &mesh.normals[0],
+				mesh.vertices.size() / 4, &mesh.boneIndices[0], &mesh.boneWeights[0],
+				&mesh.boneNodes[0], &mesh.inverseBindPoses[0], mesh.boneNodes.size()));
+			vbo->ViewVertexBuffer(m_skin->GetVertexBuffer(), m_skin->GetVertexCount() * 4, m_skin);
+			if (m_skin->GetNormalBuffer() != nullptr)
+				vbo->ViewNormalBuffer(m_skin->GetNormalBuffer(), m_skin->GetVertexCount() * 3, m_skin);
+			m_skinVBO = vbo;
+		}
+		else
+		{
+			vbo->CopyVertexBuffer(fbx.GetVertexBuffer(), fbx.GetVertexCount() * 4);
+			vbo->CopyNormalBuffer(fbx.GetNormalBuffer(), fbx.GetNormalCount() * 3);
+		}
+		vbo->CopyIndexBuffer(fbx.GetIndexBuffer(), fbx.GetIndexCount());
+		vbo->CopyUVBuffer(fbx.GetUVBuffer(), fbx.GetUVCount() * 2);
+		vbo->m_attributeLayout = VertexBufferObject::ATTRIBUTES_PER_VERTEX;
 
 		//vbo->m_cullMode = VertexBufferObject::CULL_NONE;
 		//vbo->m_mode = VertexBufferObject::RENDER_LINE;
 		vbo->m_mode = VertexBufferObject::RENDER_TRIANGLE;
 		m_vbo1 = Soft3dPipeline::Instance()->SetVBO(vbo);
-		m_vbo2 = Soft3dPipeline::Instance()->SetVBO(vbo);
 
 		//uint32 tex_data[] = {
 		//	0xFFFFFF, 0x3FBCEF, 0xFFFFFF, 0x3FBCEF,
@@ -35,25 +55,35 @@ namespace soft3d
 		//	0xFFFFFF, 0x3FBCEF, 0xFFFFFF, 0x3FBCEF,
 		//	0x3FBCEF, 0xFFFFFF, 0x3FBCEF, 0xFFFFFF,
 		//};
-		TextureLoader::Instance().LoadTexture(L"earthmap.jpg");
-
-		shared_ptr<Texture> tex(new Texture());
-		tex->CopyFromBuffer(TextureLoader::Instance().GetData(), TextureLoader::Instance().GetWidth(), TextureLoader::Instance().GetHeight());
-		Soft3dPipeline::Instance()->SetTexture(tex);
+		//the mesh stays synchronous, the same parse bakes the animation Update plays from the first frame on
+		Soft3dPipeline::Instance()->SetTexture(AssetLoader::Instance().GetPlaceholderTexture());
+		AssetLoader::Instance().LoadTextureAsync("earthmap.jpg", boost::bind(&SceneManagerFbx::OnTextureLoaded, this, _1));
 
 		Soft3dPipeline::Instance()->AddKeyboardEventCB(boost::bind(&SceneManagerFbx::KeyboardEventCB, this, _1));
 	}
 
+	void SceneManagerFbx::OnTextureLoaded(shared_ptr<Texture> tex)
+	{
+		if (tex != nullptr)
+			Soft3dPipeline::Instance()->SetTexture(tex);
+	}
+
 	void SceneManagerFbx::Update()
 	{
 		double time = GetTickCount() / 1000.0;
-		FbxAMatrix& fmat = m_fbx.GetRootMatrixLocalAtTime(time);
-		mat4 anim_mat;
-		for (int m = 0; m < 4; m++)
-			for (int n = 0; n < 4; n++)
-			{
-				anim_mat[m][n] = fmat.mData[m][n];
-			}
+		mat4 anim_mat = mat4::identity();
+		if (m_skin)
+		{
+			//the skin carries the whole animation, its vertices come out in scene space
+			m_animation->EvaluateGlobal(time, &m_pose[0]);
+			m_skin->Deform(&m_pose[0]);
+			m_skinVBO->MarkDirty();
+		}
+		else if (!m_pose.empty())
+		{
+			m_animation->EvaluateLocal(time, &m_pose[0]);
+			anim_mat = m_pose[0];
+		}
 
 		float aspect = (float)m_width / (float)m_height;
 		mat4 proj_matrix = perspective(30.0f, aspect, 0.1f, 1000.0f);
@@ -65,32 +95,25 @@ namespace soft3d
 		float x = cos(m_light_angle_y) * 50000;
 		float z = sin(m_light_angle_y) * 50000;
 
-		Soft3dPipeline::Instance()->SelectVBO(m_vbo1);
-		mat4 mv_matrix = view_matrix
-			* translate(1.1f + m_x_offset, 0.0f + m_y_offset, -0.5f + m_z_offset)
-			* scale(1.0f)
-			* rotate(m_x_angle, vec3(1.0f, 0.0f, 0.0f))
-			* rotate(m_y_angle, vec3(0.0f, 1.0f, 0.0f))
-			* rotate(m_z_angle, vec3(0.0f, 0.0f, 1.0f))
-			* anim_mat;
-
-		SetUniform(UNIFORM_MV_MATRIX, mv_matrix);
-		SetUniform(UNIFORM_PROJ_MATRIX, proj_matrix);
-		SetUniform(UNIFORM_VIEW_MATRIX, view_matrix);
-		SetUniform(UNIFORM_LIGHT_DIR, vec3(x, 0.0f, z));
-		
-		Soft3dPipeline::Instance()->SelectVBO(m_vbo2);
-		mv_matrix = view_matrix
-			* translate(-1.1f + m_x_offset, 0.0f + m_y_offset, -0.5f + m_z_offset)
-			* scale(1.0f)
+		//both spheres are instances of one vbo, the animated one on the right
+		mat4 rotation = scale(1.0f)
 			* rotate(m_x_angle, vec3(1.0f, 0.0f, 0.0f))
 			* rotate(m_y_angle, vec3(0.0f, 1.0f, 0.0f))
 			* rotate(m_z_angle, vec3(0.0f, 0.0f, 1.0f));
+		mat4 instances[2] = {
+			translate(1.1f + m_x_offset, 0.0f + m_y_offset, -0.5f + m_z_offset) * rotation * anim_mat,
+			translate(-1.1f + m_x_offset, 0.0f + m_y_offset, -0.5f + m_z_offset) * rotation,
+		};
 
-		SetUniform(UNIFORM_MV_MATRIX, mv_matrix);
-		SetUniform(UNIFORM_PROJ_MATRIX, proj_matrix);
-		SetUniform(UNIFORM_VIEW_MATRIX, view_matrix);
-		SetUniform(UNIFORM_LIGHT_DIR, vec3(x, 0.0f, z));
+		Soft3dPipeline::Instance()->SelectVBO(m_vbo1);
+		Soft3dPipeline::Instance()->SetInstances(instances, 2);
+		DefaultUniforms uniforms;
+		uniforms.mv_matrix = view_matrix;
+		uniforms.proj_matrix = proj_matrix;
+		uniforms.view_matrix = view_matrix;
+		uniforms.light_mode = DefaultUniforms::LIGHT_DIRECTIONAL;
+		uniforms.light_dir = vec3(x, 0.0f, z);
+		Soft3dPipeline::Instance()->SetUniforms(uniforms);
 		
 		Soft3dPipeline::Instance()->Clear(0);
 	}
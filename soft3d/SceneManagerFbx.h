@@ -1,6 +1,7 @@
 #pragma once
 #include "SceneManager.h"
-#include "FbxLoader.h"
+#include "AnimationClip.h"
+#include "SkinnedMesh.h"
 
 namespace soft3d
 {
@@ -13,6 +14,7 @@ namespace soft3d
 		virtual void InitScene(soft3d::uint16 width, soft3d::uint16 height);
 		virtual void Update();
 		void KeyboardEventCB(const DIKEYBOARD dikeyboard);
+		void OnTextureLoaded(std::shared_ptr<Texture> tex);
 
 	private:
 		float m_x_angle = 90.0f;
@@ -26,9 +28,11 @@ namespace soft3d
 		float m_z_offset = 0.0f;
 
 		int m_vbo1;
-		int m_vbo2;
 
-		FbxLoader m_fbx;
+		std::shared_ptr<const AnimationClip> m_animation;
+		std::vector<vmath::mat4> m_pose;
+		std::shared_ptr<SkinnedMesh> m_skin;//null unless the mesh has a skin deformer
+		std::shared_ptr<VertexBufferObject> m_skinVBO;//views the skin output, marked dirty after every Deform
 	};
 
 }
\ No newline at end of file
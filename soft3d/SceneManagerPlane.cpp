@@ -1,7 +1,6 @@
 #include "soft3d.h"
 #include "SceneManagerPlane.h"
-#include "TextureLoader.h"
-#include "FbxLoader.h"
+#include "AssetLoader.h"
 #include <boost/bind.hpp>
 
 using namespace std;
@@ -16,36 +15,30 @@ namespace soft3d
 		m_width = width;
 		m_height = height;
 
-		FbxLoader fbxLoader;
-		fbxLoader.LoadFbx("plane2x2.fbx");
-
-		shared_ptr<VertexBufferObject> vbo(new VertexBufferObject());
-		vbo->CopyVertexBuffer(fbxLoader.GetVertexBuffer(), fbxLoader.GetVertexCount() * 4);
-		vbo->CopyIndexBuffer(fbxLoader.GetIndexBuffer(), fbxLoader.GetIndexCount());
-		vbo->CopyNormalBuffer(fbxLoader.GetNormalBuffer(), fbxLoader.GetNormalCount() * 3);
-		vbo->CopyUVBuffer(fbxLoader.GetUVBuffer(), fbxLoader.GetUVCount() * 2);
-
-		vbo->m_mode = VertexBufferObject::RENDER_TRIANGLE;
-		vbo->m_cullMode = VertexBufferObject::CULL_NONE;
-		m_vbo1 = Soft3dPipeline::Instance()->SetVBO(vbo);
+		//an empty vbo and a placeholder texture keep the scene drawable until the assets arrive
+		m_vbo1 = Soft3dPipeline::Instance()->SetVBO(shared_ptr<VertexBufferObject>(new VertexBufferObject()));
+		Soft3dPipeline::Instance()->SetTexture(AssetLoader::Instance().GetPlaceholderTexture());
+		AssetLoader::Instance().LoadMeshAsync("plane2x2.fbx", boost::bind(&SceneManagerPlane::OnMeshLoaded, this, _1));
+		AssetLoader::Instance().LoadTextureAsync("cathead_small.png", boost::bind(&SceneManagerPlane::OnTextureLoaded, this, _1));
 		//vbo->m_mode = VertexBufferObject::RENDER_LINE;
 		//m_vbo2 = Soft3dPipeline::Instance()->SetVBO(vbo);
 
-		shared_ptr<Texture> tex(new Texture());
-		TextureLoader::Instance().LoadTexture(L"cathead_small.png");
-		tex->CopyFromBuffer(TextureLoader::Instance().GetData(), TextureLoader::Instance().GetWidth(), TextureLoader::Instance().GetHeight());
-		//tex->filter_mode = Texture::NEAREST;
+		Soft3dPipeline::Instance()->AddKeyboardEventCB(boost::bind(&SceneManagerPlane::KeyboardEventCB, this, _1));
+	}
 
-		//uint32 tex_data[] = {
-		//	0xFFFFFF, 0x000000, 0xFFFFFF, 0x000000,
-		//	0x000000, 0xFFFFFF, 0x000000, 0xFFFFFF,
-		//	0xFFFFFF, 0x000000, 0xFFFFFF, 0x000000,
-		//	0x000000, 0xFFFFFF, 0x000000, 0xFFFF00,
-		//};
-		//tex->CopyFromBuffer(tex_data, 4, 4);
-		Soft3dPipeline::Instance()->SetTexture(tex);
+	void SceneManagerPlane::OnMeshLoaded(shared_ptr<VertexBufferObject> vbo)
+	{
+		if (vbo == nullptr)
+			return;
+		vbo->m_cullMode = VertexBufferObject::CULL_NONE;
+		vbo->m_mode = VertexBufferObject::RENDER_TRIANGLE;
+		Soft3dPipeline::Instance()->ReplaceVBO(m_vbo1, vbo);
+	}
 
-		Soft3dPipeline::Instance()->AddKeyboardEventCB(boost::bind(&SceneManagerPlane::KeyboardEventCB, this, _1));
+	void SceneManagerPlane::OnTextureLoaded(shared_ptr<Texture> tex)
+	{
+		if (tex != nullptr)
+			Soft3dPipeline::Instance()->SetTexture(tex);
 	}
 
 	void SceneManagerPlane::Update()
@@ -64,13 +57,14 @@ namespace soft3d
 			* rotate(m_z_angle, vec3(0.0f, 0.0f, 1.0f));
 
 		Soft3dPipeline::Instance()->SelectVBO(m_vbo1);
-		SetUniform(UNIFORM_MV_MATRIX, mv_matrix);
-		SetUniform(UNIFORM_PROJ_MATRIX, proj_matrix);
-		//SetUniform(UNIFORM_LIGHT_POS, vec3(0.0f, 0.0f, -100.0f));
+		DefaultUniforms uniforms;
+		uniforms.mv_matrix = mv_matrix;
+		uniforms.proj_matrix = proj_matrix;
+		//uniforms.light_mode = DefaultUniforms::LIGHT_POINT;
+		//uniforms.light_pos = vec3(0.0f, 0.0f, -100.0f);
+		Soft3dPipeline::Instance()->SetUniforms(uniforms);
 		//Soft3dPipeline::Instance()->SelectVBO(m_vbo2);
-		//SetUniform(UNIFORM_MV_MATRIX, mv_matrix);
-		//SetUniform(UNIFORM_PROJ_MATRIX, proj_matrix);
-		//SetUniform(UNIFORM_LIGHT_POS, vec3(0.0f, 0.0f, -100.0f));
+		//Soft3dPipeline::Instance()->SetUniforms(uniforms);
 
 		Soft3dPipeline::Instance()->Clear(0xffffff);
 	}
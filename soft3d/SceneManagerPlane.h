@@ -13,6 +13,8 @@ namespace soft3d
 		virtual void InitScene(soft3d::uint16 width, soft3d::uint16 height);
 		virtual void Update();
 		void KeyboardEventCB(const DIKEYBOARD dikeyboard);
+		void OnMeshLoaded(std::shared_ptr<VertexBufferObject> vbo);
+		void OnTextureLoaded(std::shared_ptr<Texture> tex);
 
 	private:
 		float m_x_offset = 0.0f;
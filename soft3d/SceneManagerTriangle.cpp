@@ -108,8 +108,10 @@ void SceneManagerTriangle::Update()
 	float factor = 0;// GetTickCount() / 50 % 360;
 	mat4 mv_matrix = view_matrix * translate(m_x_offset, m_y_offset, m_z_offset) * scale(1.0f) * rotate(factor, vec3(0.0f, 1.0f, 0.0f));
 
-	SetUniform(0, mv_matrix);
-	SetUniform(1, proj_matrix);
+	DefaultUniforms uniforms;
+	uniforms.mv_matrix = mv_matrix;
+	uniforms.proj_matrix = proj_matrix;
+	Soft3dPipeline::Instance()->SetUniforms(uniforms);
 
 	Soft3dPipeline::Instance()->Clear(0xffffff);
 }
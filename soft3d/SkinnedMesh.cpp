@@ -0,0 +1,165 @@
+#include "SkinnedMesh.h"
+#include "ThreadPool.h"
+#include <boost/bind.hpp>
+#include <xmmintrin.h>
+
+using namespace vmath;
+
+namespace soft3d
+{
+
+	SkinnedMesh::SkinnedMesh(const float* vertices, const float* normals, uint32 vertexCount,
+		const uint16* boneIndices, const float* boneWeights,
+		const int* boneNodes, const mat4* inverseBindPoses, uint32 boneCount) :
+		m_vertexCount(vertexCount),
+		m_paddedCount((vertexCount + 3) & ~3),
+		m_hasNormal(normals != nullptr),
+		m_boneNodes(boneNodes, boneNodes + boneCount),
+		m_inverseBindPoses(inverseBindPoses, inverseBindPoses + boneCount)
+	{
+		//an unskinned mesh still deforms, everything follows a single identity bone
+		if (m_boneNodes.empty())
+		{
+			m_boneNodes.push_back(-1);
+			m_inverseBindPoses.push_back(mat4::identity());
+		}
+		m_palette.assign(m_boneNodes.size(), mat4::identity());
+
+		m_x.assign(m_paddedCount, 0.0f);
+		m_y.assign(m_paddedCount, 0.0f);
+		m_z.assign(m_paddedCount, 0.0f);
+		m_nx.assign(m_paddedCount, 0.0f);
+		m_ny.assign(m_paddedCount, 0.0f);
+		m_nz.assign(m_paddedCount, 0.0f);
+		for (int k = 0; k < MAX_INFLUENCES; k++)
+		{
+			m_weights[k].assign(m_paddedCount, k == 0 ? 1.0f : 0.0f);
+			m_bones[k].assign(m_paddedCount, 0);
+		}
+
+		for (uint32 i = 0; i < vertexCount; i++)
+		{
+			m_x[i] = vertices[i * 4];
+			m_y[i] = vertices[i * 4 + 1];
+			m_z[i] = vertices[i * 4 + 2];
+			if (m_hasNormal)
+			{
+				m_nx[i] = normals[i * 3];
+				m_ny[i] = normals[i * 3 + 1];
+				m_nz[i] = normals[i * 3 + 2];
+			}
+			if (boneIndices != nullptr && boneWeights != nullptr)
+			{
+				for (int k = 0; k < MAX_INFLUENCES; k++)
+				{
+					uint16 bone = boneIndices[i * MAX_INFLUENCES + k];
+					m_bones[k][i] = bone < m_boneNodes.size() ? bone : 0;
+					m_weights[k][i] = boneWeights[i * MAX_INFLUENCES + k];
+				}
+			}
+		}
+
+		m_vertices.assign(vertices, vertices + vertexCount * 4);
+		m_vertices.resize(m_paddedCount * 4, 0.0f);
+		if (m_hasNormal)
+			m_normals.assign(normals, normals + vertexCount * 3);
+		m_normals.resize(m_paddedCount * 3, 0.0f);
+	}
+
+	void SkinnedMesh::Deform(const mat4* nodeMatrices)
+	{
+		for (uint32 b = 0; b < m_boneNodes.size(); b++)
+		{
+			if (m_boneNodes[b] >= 0)
+				m_palette[b] = nodeMatrices[m_boneNodes[b]] * m_inverseBindPoses[b];
+			else
+				m_palette[b] = m_inverseBindPoses[b];
+		}
+
+		uint32 blockCount = (m_paddedCount + BLOCK_SIZE - 1) / BLOCK_SIZE;
+		if (useThreadPool && blockCount > 1)
+			ThreadPool::Instance().ParallelFor(blockCount, boost::bind(&SkinnedMesh::DeformBlock, this, _1));
+		else
+		{
+			for (uint32 i = 0; i < blockCount; i++)
+				DeformBlock(i);
+		}
+	}
+
+	//four vertices per iteration, lanes are vertices: the bone columns of each lane are transposed
+	//into SoA, blended by weight and applied to the bind pose streams
+	void SkinnedMesh::DeformBlock(uint32 block)
+	{
+		uint32 begin = block * BLOCK_SIZE;
+		uint32 end = std::min<uint32>(begin + BLOCK_SIZE, m_paddedCount);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+
+		for (uint32 i = begin; i < end; i += 4)
+		{
+			//blended affine matrix, m[col][row] holds that element for the four vertices
+			__m128 m[4][3];
+			for (int c = 0; c < 4; c++)
+				m[c][0] = m[c][1] = m[c][2] = zero;
+
+			for (int k = 0; k < MAX_INFLUENCES; k++)
+			{
+				__m128 w = _mm_loadu_ps(&m_weights[k][i]);
+				//most vertices use fewer than four bones
+				if (_mm_movemask_ps(_mm_cmpneq_ps(w, zero)) == 0)
+					continue;
+				const float* b0 = &m_palette[m_bones[k][i]][0][0];
+				const float* b1 = &m_palette[m_bones[k][i + 1]][0][0];
+				const float* b2 = &m_palette[m_bones[k][i + 2]][0][0];
+				const float* b3 = &m_palette[m_bones[k][i + 3]][0][0];
+				for (int c = 0; c < 4; c++)
+				{
+					__m128 r0 = _mm_loadu_ps(b0 + c * 4);
+					__m128 r1 = _mm_loadu_ps(b1 + c * 4);
+					__m128 r2 = _mm_loadu_ps(b2 + c * 4);
+					__m128 r3 = _mm_loadu_ps(b3 + c * 4);
+					_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+					m[c][0] = _mm_add_ps(m[c][0], _mm_mul_ps(r0, w));
+					m[c][1] = _mm_add_ps(m[c][1], _mm_mul_ps(r1, w));
+					m[c][2] = _mm_add_ps(m[c][2], _mm_mul_ps(r2, w));
+				}
+			}
+
+			__m128 x = _mm_loadu_ps(&m_x[i]);
+			__m128 y = _mm_loadu_ps(&m_y[i]);
+			__m128 z = _mm_loadu_ps(&m_z[i]);
+			__m128 p[4];
+			for (int r = 0; r < 3; r++)
+				p[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][r], x), _mm_mul_ps(m[1][r], y)), _mm_add_ps(_mm_mul_ps(m[2][r], z), m[3][r]));
+			p[3] = one;
+			_MM_TRANSPOSE4_PS(p[0], p[1], p[2], p[3]);
+			float* out = &m_vertices[i * 4];
+			_mm_storeu_ps(out, p[0]);
+			_mm_storeu_ps(out + 4, p[1]);
+			_mm_storeu_ps(out + 8, p[2]);
+			_mm_storeu_ps(out + 12, p[3]);
+
+			if (m_hasNormal)
+			{
+				//the blended matrix is used as is, the fragment stage renormalizes
+				__m128 nx = _mm_loadu_ps(&m_nx[i]);
+				__m128 ny = _mm_loadu_ps(&m_ny[i]);
+				__m128 nz = _mm_loadu_ps(&m_nz[i]);
+				__m128 n[4];
+				for (int r = 0; r < 3; r++)
+					n[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][r], nx), _mm_mul_ps(m[1][r], ny)), _mm_mul_ps(m[2][r], nz));
+				n[3] = zero;
+				_MM_TRANSPOSE4_PS(n[0], n[1], n[2], n[3]);
+				//xyz strides overlap, each store's fourth float is overwritten by the next one;
+				//the last vertex stores only xyz so no write reaches into another block
+				float* nout = &m_normals[i * 3];
+				_mm_storeu_ps(nout, n[0]);
+				_mm_storeu_ps(nout + 3, n[1]);
+				_mm_storeu_ps(nout + 6, n[2]);
+				_mm_storel_pi((__m64*)(nout + 9), n[3]);
+				_mm_store_ss(nout + 11, _mm_movehl_ps(n[3], n[3]));
+			}
+		}
+	}
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "soft3d.h"
+#include <boost/noncopyable.hpp>
+#include <vector>
+
+namespace soft3d
+{
+
+	//cpu skinning in front of the vertex stage: keeps the bind pose as SoA streams and writes
+	//posed xyzw positions and xyz normals a VertexBufferObject can view through Get*Buffer
+	class SkinnedMesh : public boost::noncopyable
+	{
+	public:
+		enum { MAX_INFLUENCES = 4 };
+
+		//vertices xyzw and normals xyz per vertex, normals may be null; boneIndices and boneWeights hold
+		//MAX_INFLUENCES entries per vertex; boneNodes maps every bone to an animation node
+		SkinnedMesh(const float* vertices, const float* normals, uint32 vertexCount,
+			const uint16* boneIndices, const float* boneWeights,
+			const int* boneNodes, const vmath::mat4* inverseBindPoses, uint32 boneCount);
+
+		//poses every vertex with the global matrix of each animation node, see AnimationClip::EvaluateGlobal;
+		//rewrites the output buffers in place so call it between frames
+		void Deform(const vmath::mat4* nodeMatrices);
+
+		inline const float* GetVertexBuffer() const { return &m_vertices[0]; }
+		inline const float* GetNormalBuffer() const { return m_hasNormal ? &m_normals[0] : nullptr; }
+		inline uint32 GetVertexCount() const { return m_vertexCount; }
+		inline uint32 GetBoneCount() const { return m_boneNodes.size(); }
+
+		bool useThreadPool = true;//spreads Deform over ThreadPool in blocks of BLOCK_SIZE vertices
+
+	private:
+		enum { BLOCK_SIZE = 1024 };
+		void DeformBlock(uint32 block);
+
+		uint32 m_vertexCount;
+		uint32 m_paddedCount;//multiple of four, padding vertices are bound to bone 0 with weight 1
+		bool m_hasNormal;
+
+		//bind pose, one stream per component
+		std::vector<float> m_x, m_y, m_z;
+		std::vector<float> m_nx, m_ny, m_nz;
+		std::vector<float> m_weights[MAX_INFLUENCES];
+		std::vector<uint16> m_bones[MAX_INFLUENCES];
+
+		std::vector<int> m_boneNodes;
+		std::vector<vmath::mat4> m_inverseBindPoses;
+		std::vector<vmath::mat4> m_palette;//node matrix * inverse bind pose of every bone, current pose
+
+		std::vector<float> m_vertices;
+		std::vector<float> m_normals;
+	};
+
+}
@@ -0,0 +1,104 @@
+#include "soft3d.h"
+#include "SkinningBenchmark.h"
+#include "SkinnedMesh.h"
+#include "ThreadPool.h"
+#include <chrono>
+
+using namespace vmath;
+
+namespace soft3d
+{
+
+	float SkinningBenchmark::s_sink = 0.0f;
+
+	double SkinningBenchmark::Run(uint32 vertexCount, uint32 boneCount, int influences, bool simd, bool threaded, int iterations)
+	{
+		std::vector<float> vertices(vertexCount * 4);
+		std::vector<float> normals(vertexCount * 3);
+		std::vector<uint16> bones(vertexCount * SkinnedMesh::MAX_INFLUENCES, 0);
+		std::vector<float> weights(vertexCount * SkinnedMesh::MAX_INFLUENCES, 0.0f);
+		for (uint32 i = 0; i < vertexCount; i++)
+		{
+			float a = i * 0.001f;
+			vertices[i * 4] = cos(a);
+			vertices[i * 4 + 1] = i * 0.0001f;
+			vertices[i * 4 + 2] = sin(a);
+			vertices[i * 4 + 3] = 1.0f;
+			normals[i * 3] = cos(a);
+			normals[i * 3 + 1] = 0.0f;
+			normals[i * 3 + 2] = sin(a);
+			for (int k = 0; k < influences; k++)
+			{
+				bones[i * SkinnedMesh::MAX_INFLUENCES + k] = (i / 97 + k * 7) % boneCount;
+				weights[i * SkinnedMesh::MAX_INFLUENCES + k] = 1.0f / influences;
+			}
+		}
+
+		std::vector<int> boneNodes(boneCount);
+		std::vector<mat4> bindPoses(boneCount, mat4::identity());
+		std::vector<mat4> nodes(boneCount);
+		for (uint32 b = 0; b < boneCount; b++)
+		{
+			boneNodes[b] = b;
+			nodes[b] = translate(0.0f, b * 0.1f, 0.0f) * rotate(b * 5.0f, vec3(0.0f, 1.0f, 0.0f));
+		}
+
+		SkinnedMesh mesh(&vertices[0], &normals[0], vertexCount, &bones[0], &weights[0], &boneNodes[0], &bindPoses[0], boneCount);
+		mesh.useThreadPool = threaded;
+		std::vector<float> outVertices(vertexCount * 4);
+		std::vector<float> outNormals(vertexCount * 3);
+		std::vector<mat4> palette(boneCount);
+
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		for (int it = 0; it < iterations; it++)
+		{
+			if (simd)
+			{
+				mesh.Deform(&nodes[0]);
+				continue;
+			}
+			//the same work as Deform done one vertex at a time: palette once per pose, then
+			//positions and normals through the weighted bone matrices
+			for (uint32 b = 0; b < boneCount; b++)
+				palette[b] = nodes[boneNodes[b]] * bindPoses[b];
+			for (uint32 i = 0; i < vertexCount; i++)
+			{
+				vec4 pos(vertices[i * 4], vertices[i * 4 + 1], vertices[i * 4 + 2], 1.0f);
+				vec4 nor(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2], 0.0f);
+				vec4 skinned(0.0f);
+				vec4 skinnedNormal(0.0f);
+				for (int k = 0; k < influences; k++)
+				{
+					const mat4& m = palette[bones[i * SkinnedMesh::MAX_INFLUENCES + k]];
+					float w = weights[i * SkinnedMesh::MAX_INFLUENCES + k];
+					skinned += m * pos * w;
+					skinnedNormal += m * nor * w;
+				}
+				memcpy(&outVertices[i * 4], &skinned[0], 4 * sizeof(float));
+				memcpy(&outNormals[i * 3], &skinnedNormal[0], 3 * sizeof(float));
+			}
+		}
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+		s_sink += simd ? mesh.GetVertexBuffer()[vertexCount * 2] + mesh.GetNormalBuffer()[vertexCount]
+			: outVertices[vertexCount * 2] + outNormals[vertexCount];
+		return std::chrono::duration<double, std::milli>(end - begin).count() / iterations;
+	}
+
+	void SkinningBenchmark::Report(FILE* out, uint32 vertexCount, uint32 boneCount, int iterations)
+	{
+		fprintf(out, "skinning benchmark %u vertices, %u bones, %d iterations, %u threads\n",
+			vertexCount, boneCount, iterations, ThreadPool::Instance().GetThreadCount());
+		fprintf(out, "%-10s %12s %12s %12s %14s\n", "influences", "scalar(ms)", "simd(ms)", "pool(ms)", "pool(Mvert/s)");
+		int influences[3] = { 1, 2, 4 };
+		for (int i = 0; i < 3; i++)
+		{
+			double scalarMs = Run(vertexCount, boneCount, influences[i], false, false, iterations);
+			double simdMs = Run(vertexCount, boneCount, influences[i], true, false, iterations);
+			double poolMs = Run(vertexCount, boneCount, influences[i], true, true, iterations);
+			fprintf(out, "%-10d %12.2f %12.2f %12.2f %14.1f\n", influences[i], scalarMs, simdMs, poolMs, vertexCount / poolMs / 1000.0);
+		}
+		fprintf(out, "checksum %f\n", s_sink);
+	}
+
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <stdio.h>
+#include "soft3d.h"
+
+namespace soft3d
+{
+
+	class SkinningBenchmark
+	{
+	public:
+		//deforms a synthetic mesh of vertexCount vertices with the given influences per vertex over boneCount
+		//bones and returns the elapsed milliseconds per pose; simd false runs a plain scalar reference instead
+		static double Run(uint32 vertexCount, uint32 boneCount, int influences, bool simd, bool threaded, int iterations);
+		//prints skinned vertices per second for 1, 2 and 4 influences, scalar against SkinnedMesh
+		static void Report(FILE* out, uint32 vertexCount = 200000, uint32 boneCount = 64, int iterations = 20);
+
+	private:
+		static float s_sink;
+	};
+
+}
@@ -6,7 +6,9 @@
 #include "FragmentProcessor.h"
 #include "Rasterizer.h"
 #include "RasterizerManager.h"
+#include "AssetLoader.h"
 #include <boost/foreach.hpp>
+#include <boost/bind.hpp>
 
 #pragma comment(lib, "dinput8.lib")
 #pragma comment(lib, "DXGuid.lib")
@@ -46,14 +48,6 @@ namespace soft3d
 
 	Soft3dPipeline::~Soft3dPipeline()
 	{
-		BOOST_FOREACH(UniformPtr* us, m_UniformVector)
-		{
-			for (int i = 0; i < 16; i++)
-			{
-				if (us[i] != nullptr)
-					delete us[i];
-			}
-		}
 	}
 
 	void Soft3dPipeline::InitPipeline(HINSTANCE hInstance, HWND hwnd, uint16 width, uint16 height)
@@ -64,6 +58,12 @@ namespace soft3d
 		THREAD_COUNT = info.dwNumberOfProcessors - 1;
 		m_width = width;
 		m_height = height;
+		m_renderWidth = width;
+		m_renderHeight = height;
+		m_frameCounter.QuadPart = 0;
+		m_rasterCounter.QuadPart = 0;
+		QueryPerformanceFrequency(&m_counterFrequency);
+		m_dirtyTiles.Resize(width, height);
 		if (m_threadMode == THREAD_MULTI_RASTERIZER)
 		{
 			for (int i = 0; i < THREAD_COUNT; i++)
@@ -78,6 +78,12 @@ namespace soft3d
 			m_rasterizer = shared_ptr<Rasterizer>(new Rasterizer(width, height));
 		}
 		soft3d::DirectXHelper::Instance()->Init(hwnd);
+		if (m_threadMode != THREAD_MULTI_FRAGMENT)
+		{
+			m_frameChain = shared_ptr<FrameBufferChain>(new FrameBufferChain(width, height, FRAME_BUFFER_COUNT,
+				boost::bind(&DirectXHelper::Paint, DirectXHelper::Instance(), _1, width, height)));
+			m_dirtyHistory.resize(m_frameChain->GetCount());
+		}
 		SceneManager::Instance()->InitScene(width, height);
 
 		DirectInput8Create(hInstance, 0x0800, IID_IDirectInput8, (void**)&m_pDirectInput, NULL);
@@ -95,70 +101,352 @@ namespace soft3d
 		m_valid = true;
 	}
 
-	int Soft3dPipeline::SetVBO(shared_ptr<VertexBufferObject> vbo)
+	shared_ptr<PipeLineData> Soft3dPipeline::CreatePipeLineData(const VertexBufferObject* vbo)
 	{
 		shared_ptr<PipeLineData> pd(new PipeLineData());
-		pd->vp = boost::shared_array<VertexProcessor>(new VertexProcessor[vbo->GetSize()]);
 		pd->cullMode = vbo->m_cullMode;
 		pd->renderMode = vbo->m_mode;
-		pd->capacity = vbo->GetSize();
-		UniformStack stack = new UniformPtr[16]{ nullptr };
+		pd->vertexCount = vbo->GetSize();
+		pd->instanceCount = 1;
+		pd->capacity = 0;
+		AllocateVertexProcessors(pd.get());
+		return pd;
+	}
+
+	void Soft3dPipeline::AllocateVertexProcessors(PipeLineData* pd)
+	{
+		uint32 capacity = pd->vertexCount * pd->instanceCount;
+		if (capacity == pd->capacity && pd->vp)
+			return;
+		pd->vp = boost::shared_array<VertexProcessor>(new VertexProcessor[capacity]);
+		pd->vpBack = boost::shared_array<VertexProcessor>(new VertexProcessor[capacity]);
+		pd->capacity = capacity;
+	}
+
+	int Soft3dPipeline::SetVBO(shared_ptr<VertexBufferObject> vbo)
+	{
+		shared_ptr<PipeLineData> pd = CreatePipeLineData(vbo.get());
 
 		m_pipeDataVector.push_back(pd);
 		m_vboVector.push_back(vbo);
-		m_UniformVector.push_back(stack);
+		m_uniformBlocks.push_back(nullptr);
+		m_uniformVersions.push_back(0);
 		m_curVBO = m_vboVector.size() - 1;
 		return m_curVBO;
 	}
 
+	void Soft3dPipeline::ReplaceVBO(uint32 vboIndex, shared_ptr<VertexBufferObject> vbo)
+	{
+		if (vboIndex >= m_vboVector.size())
+			return;
+		shared_ptr<PipeLineData> pd = CreatePipeLineData(vbo.get());
+		shared_ptr<PipeLineData>& old = m_pipeDataVector[vboIndex];
+		pd->instanceCount = old->instanceCount;
+		pd->instanceMatrices.swap(old->instanceMatrices);
+		pd->instanceColors.swap(old->instanceColors);
+		pd->instanceMV.swap(old->instanceMV);
+		pd->viewport = old->viewport;
+		pd->scissor = old->scissor;
+		//the tiles the old mesh covered are cleared with the first frame of the new one
+		pd->tileCoverage = old->tileCoverage;
+		AllocateVertexProcessors(pd.get());
+		m_pipeDataVector[vboIndex] = pd;
+		m_vboVector[vboIndex] = vbo;
+	}
+
 	void Soft3dPipeline::SelectVBO(uint32 vboIndex)
 	{
 		m_curVBO = vboIndex;
 	}
 
-	void Soft3dPipeline::SetUniform(uint16 index, void* uniform)
+	void Soft3dPipeline::SetUniforms(const DefaultUniforms& uniforms)
+	{
+		const DefaultUniforms* old = m_uniformBlocks[m_curVBO];
+		if (old == nullptr || memcmp(old, &uniforms, sizeof(DefaultUniforms)) != 0)
+			m_uniformVersions[m_curVBO]++;
+		m_uniformBlocks[m_curVBO] = m_uniformArena[m_arenaIndex].New(uniforms);
+	}
+
+	void Soft3dPipeline::BeginFrame()
 	{
-		if (index < VertexBufferObject::MAX_UNIFORM_COUNT)
+		//blocks not set again this frame carry over, the last frame's arena stays intact meanwhile
+		m_arenaIndex ^= 1;
+		m_uniformArena[m_arenaIndex].Reset();
+		for (size_t i = 0; i < m_uniformBlocks.size(); i++)
 		{
-			if (m_UniformVector[m_curVBO][index] != nullptr)
-			{
-				delete m_UniformVector[m_curVBO][index];
-				m_UniformVector[m_curVBO][index] = nullptr;
-			}
-			m_UniformVector[m_curVBO][index] = uniform;
+			if (m_uniformBlocks[i] != nullptr)
+				m_uniformBlocks[i] = m_uniformArena[m_arenaIndex].New(*m_uniformBlocks[i]);
 		}
 	}
 
+	void Soft3dPipeline::SetInstances(const mat4* matrices, uint32 count, const uint32* colors)
+	{
+		PipeLineData* pd = m_pipeDataVector[m_curVBO].get();
+		if (count == 0 || matrices == nullptr)
+		{
+			if (!pd->instanceMatrices.empty())
+				pd->instanceVersion++;
+			pd->instanceMatrices.clear();
+			pd->instanceColors.clear();
+			pd->instanceMV.clear();
+			pd->instanceCount = 1;
+		}
+		else
+		{
+			//an unchanged set keeps the transformed vertices of the last frame
+			bool same = pd->instanceMatrices.size() == count
+				&& memcmp(&pd->instanceMatrices[0], matrices, count * sizeof(mat4)) == 0
+				&& (colors == nullptr ? pd->instanceColors.empty()
+					: pd->instanceColors.size() == count && memcmp(&pd->instanceColors[0], colors, count * sizeof(uint32)) == 0);
+			if (same)
+				return;
+			pd->instanceVersion++;
+			pd->instanceMatrices.assign(matrices, matrices + count);
+			if (colors != nullptr)
+				pd->instanceColors.assign(colors, colors + count);
+			else
+				pd->instanceColors.clear();
+			pd->instanceMV.resize(count);
+			pd->instanceCount = count;
+		}
+		AllocateVertexProcessors(pd);
+	}
+
 	void Soft3dPipeline::SetTexture(shared_ptr<Texture> tex)
 	{
 		m_tex = tex;
 	}
 
-	int Soft3dPipeline::Clear(uint32 color)
+	void Soft3dPipeline::SetViewport(int x, int y, int width, int height)
 	{
-		if (m_threadMode == THREAD_MULTI_RASTERIZER)
+		PipeLineData* pd = m_pipeDataVector[m_curVBO].get();
+		DrawRect rect;
+		rect.x = x;
+		rect.y = y;
+		rect.width = width;
+		rect.height = height;
+		if (rect != pd->viewport)
 		{
-			for (int i = 0; i < THREAD_COUNT; i++)
-				m_rasterizers[i]->Clear(color);
+			pd->viewport = rect;
+			pd->rectVersion++;
 		}
-		else if (m_threadMode == THREAD_MULTI_FRAGMENT)
+	}
+
+	void Soft3dPipeline::SetScissor(int x, int y, int width, int height)
+	{
+		PipeLineData* pd = m_pipeDataVector[m_curVBO].get();
+		DrawRect rect;
+		rect.x = x;
+		rect.y = y;
+		rect.width = width;
+		rect.height = height;
+		if (rect != pd->scissor)
 		{
-			m_rasterizerManager->Clear(color);
+			pd->scissor = rect;
+			pd->rectVersion++;
 		}
-		else
+	}
+
+	void Soft3dPipeline::RenderRect(const DrawRect& rect, int* out)
+	{
+		if (rect.IsEmpty())
 		{
-			m_rasterizer->Clear(color);
+			out[0] = 0;
+			out[1] = 0;
+			out[2] = m_renderWidth - 1;
+			out[3] = m_renderHeight - 1;
+			return;
 		}
+		//edges are rounded the same way on both sides so neighbouring rects still tile the frame
+		float sx = m_renderWidth / (float)m_width;
+		float sy = m_renderHeight / (float)m_height;
+		out[0] = (int)floorf(rect.x * sx + 0.5f);
+		out[1] = (int)floorf(rect.y * sy + 0.5f);
+		out[2] = (int)floorf((rect.x + rect.width) * sx + 0.5f) - 1;
+		out[3] = (int)floorf((rect.y + rect.height) * sy + 0.5f) - 1;
+	}
+
+	int Soft3dPipeline::Clear(uint32 color)
+	{
+		//the dirty tiles are cleared in Process once the changed draws are known
+		m_clearColor = color;
 		return 0;
 	}
 
+	//inclusive pixel bounds of a triangle, rounded outwards so every pixel the rasterizer could touch is inside
+	static inline void TriangleBounds(const VS_OUT* vo0, const VS_OUT* vo1, const VS_OUT* vo2, int* rect)
+	{
+		rect[0] = (int)floorf(vmath::min<float>(vo0->pos[0], vo1->pos[0], vo2->pos[0]));
+		rect[1] = (int)floorf(vmath::min<float>(vo0->pos[1], vo1->pos[1], vo2->pos[1]));
+		rect[2] = (int)ceilf(vmath::max<float>(vo0->pos[0], vo1->pos[0], vo2->pos[0])) + 1;
+		rect[3] = (int)ceilf(vmath::max<float>(vo0->pos[1], vo1->pos[1], vo2->pos[1])) + 1;
+	}
+
+	void Soft3dPipeline::TransformVertices(uint32 idx)
+	{
+		PipeLineData* pipeData = m_pipeDataVector[idx].get();
+		VertexBufferObject* vbo = m_vboVector[idx].get();
+		const DefaultUniforms* uniforms = m_uniformBlocks[idx];
+		bool instanced = !pipeData->instanceMatrices.empty();
+		int viewport[4];
+		RenderRect(pipeData->viewport, viewport);
+		float originX = (float)viewport[0];
+		float originY = (float)viewport[1];
+		float sizeX = (float)(viewport[2] + 1 - viewport[0]);
+		float sizeY = (float)(viewport[3] + 1 - viewport[1]);
+		if (instanced)
+		{
+			for (uint32 n = 0; n < pipeData->instanceCount; n++)
+				pipeData->instanceMV[n] = uniforms->mv_matrix * pipeData->instanceMatrices[n];
+		}
+		//object space data is fetched once per vertex and then transformed for every instance
+		for (int i = 0; i < pipeData->vertexCount; i++)
+		{
+			const vec4* pos = nullptr;
+			const uint32* colorptr = nullptr;
+			if (vbo->useIndex())
+			{
+				colorptr = vbo->GetColor(vbo->GetIndex(i));
+				pos = vbo->GetPos(vbo->GetIndex(i));
+			}
+			else
+			{
+				colorptr = vbo->GetColor(i);
+				pos = vbo->GetPos(i);
+			}
+			if (colorptr == nullptr)
+				colorptr = (uint32*)this;//ɫ
+			uint32 attr = vbo->GetAttributeIndex(i);
+			const vec3* normal = vbo->GetNormal(attr);
+
+			//null past the end of a viewed uv buffer shorter than the mesh
+			vec2 uv(0.0f);
+			const vec2* uvptr = vbo->GetUV(attr);
+			if (uvptr != nullptr)
+				uv = *uvptr;
+			//uv[0] = 1.0 - uv[0];
+			uv[1] = 1.0 - uv[1];//ԴuvǴ½ǿʼ㣬ߵuvϿʼ㣬·ת
+
+			for (uint32 n = 0; n < pipeData->instanceCount; n++)
+			{
+				VertexProcessor& cur_vp = pipeData->vp[n * pipeData->vertexCount + i];
+				cur_vp.pos = pos;
+				cur_vp.color = colorptr;
+				cur_vp.normal = normal;
+				cur_vp.vs_out.uv = uv;
+				cur_vp.vs_out.vertexID = i;
+				cur_vp.vs_out.triangleID = i / 3;
+				cur_vp.vs_out.instanceID = instanced ? n : idx;
+				cur_vp.instance_mv = instanced ? &pipeData->instanceMV[n] : nullptr;
+				cur_vp.instance_color = instanced && !pipeData->instanceColors.empty() ? &pipeData->instanceColors[n] : nullptr;
+
+				cur_vp.uniforms = uniforms;
+				cur_vp.Process();//һͼ任ͶӰ任
+
+				//w
+				float rhw = 1.0f / cur_vp.vs_out.pos[3];
+				cur_vp.vs_out.pos[0] *= rhw;
+				cur_vp.vs_out.pos[1] *= rhw;
+				cur_vp.vs_out.pos[2] *= rhw;
+				cur_vp.vs_out.pos[3] = 1.0f;
+				cur_vp.vs_out.rhw = rhw;
+
+				cur_vp.vs_out.pos[0] = originX + (cur_vp.vs_out.pos[0] + 1.0f) * 0.5f * sizeX;
+				cur_vp.vs_out.pos[1] = originY + (cur_vp.vs_out.pos[1] + 1.0f) * 0.5f * sizeY;
+
+				cur_vp.vs_out.uv *= rhw;//uvwԺ˻Ϊȷuv
+			}
+		}
+	}
+
+	void Soft3dPipeline::CullTriangles(PipeLineData* pipeData)
+	{
+		vector<uint32>& triangles = pipeData->visibleTriangles;
+		triangles.clear();
+		pipeData->tileCoverage.Resize(m_renderWidth, m_renderHeight);
+		pipeData->tileCoverage.Clear();
+		//nothing of the draw reaches outside its viewport, scissor and the screen
+		int rect[4];
+		ClipRect& clip = pipeData->clip;
+		clip.minx = 0;
+		clip.miny = 0;
+		clip.maxx = m_renderWidth - 1;
+		clip.maxy = m_renderHeight - 1;
+		RenderRect(pipeData->viewport, rect);
+		clip.Intersect(rect);
+		if (!pipeData->scissor.IsEmpty())
+		{
+			RenderRect(pipeData->scissor, rect);
+			clip.Intersect(rect);
+		}
+		for (uint32 i = 0; i + 2 < pipeData->capacity; i += 3)
+		{
+			VertexProcessor& vp1 = pipeData->vp[i];
+			VertexProcessor& vp2 = pipeData->vp[i + 1];
+			VertexProcessor& vp3 = pipeData->vp[i + 2];
+
+			VertexBufferObject::CULL_MODE cull_mode = VertexBufferObject::CULL_NONE;
+			//бѡ
+			vec4 a = vp1.vs_out.pos - vp2.vs_out.pos;
+			vec4 b = vp2.vs_out.pos - vp3.vs_out.pos;
+			vec3 c = vec3(a[0], a[1], a[2]);
+			vec3 d = vec3(b[0], b[1], b[2]);
+			vec3 r = cross(c, d);
+			if (r[2] < 0.0f)
+				cull_mode = VertexBufferObject::CULL_CW;
+			else if (r[2] > 0.0f)
+				cull_mode = VertexBufferObject::CULL_CCW;
+
+			if (pipeData->cullMode != VertexBufferObject::CULL_NONE && pipeData->cullMode != cull_mode)
+				continue;
+
+			//вü
+			if (vp1.vs_out.pos[2] < 0.0f
+				|| vp2.vs_out.pos[2] < 0.0f
+				|| vp3.vs_out.pos[2] < 0.0f)
+				continue;
+			//if (vp1.vs_out.pos[0] > m_width * 1.0f || vp1.vs_out.pos[1] > m_height * 1.0f
+			//	|| vp1.vs_out.pos[0] < 0 || vp1.vs_out.pos[1] < 0)
+			//	continue;
+			//if (vp2.vs_out.pos[0] > m_width * 1.0f || vp2.vs_out.pos[1] > m_height * 1.0f
+			//	|| vp2.vs_out.pos[0] < 0 || vp2.vs_out.pos[1] < 0)
+			//	continue;
+			//if (vp3.vs_out.pos[0] > m_width * 1.0f || vp3.vs_out.pos[1] > m_height * 1.0f
+			//	|| vp3.vs_out.pos[0] < 0 || vp3.vs_out.pos[1] < 0)
+			//	continue;
+
+			TriangleBounds(&vp1.vs_out, &vp2.vs_out, &vp3.vs_out, rect);
+			if (!clip.Clip(rect))
+				continue;
+			pipeData->tileCoverage.MarkRect(rect[0], rect[1], rect[2], rect[3]);
+
+			//make triangle always ccw sorting
+			if (cull_mode == VertexBufferObject::CULL_CW)
+			{
+				triangles.push_back(i + 2);
+				triangles.push_back(i + 1);
+				triangles.push_back(i);
+			}
+			else
+			{
+				triangles.push_back(i);
+				triangles.push_back(i + 1);
+				triangles.push_back(i + 2);
+			}
+		}
+	}
+
 	void Soft3dPipeline::Process()
 	{
 		if (m_haveFocus == false)
 		{
+			FinishFrame();
+			//the pause is not a frame time the render size should react to
+			m_frameCounter.QuadPart = 0;
 			Sleep(50);
 			return;
 		}
+		UpdateGovernors();
 		DirectXHelper::Instance()->Profile(GetTickCount(), L"");
 		DIMOUSESTATE dimouse;
 		m_pMouseDevice->GetDeviceState(sizeof(dimouse), (LPVOID)&dimouse);
@@ -174,163 +462,151 @@ namespace soft3d
 		}
 		DirectXHelper::Instance()->Profile(GetTickCount(), L"Input");
 
+		//the frame in flight only reads its own vertex outputs and its latched texture, so vbos,
+		//textures and uniforms can change under it; hand over what finished loading
+		BeginFrame();
+		AssetLoader::Instance().Dispatch();
 		SceneManager::Instance()->Update();
+		DirectXHelper::Instance()->Profile(GetTickCount(), L"Scene");
 
-		if (m_threadMode == THREAD_MULTI_RASTERIZER)
+		//the texture and clear color reach every pixel, the fragment threads keep their own frame buffer
+		//so does a new render size, the buffers hold frames of the old one, and a new quality level;
+		//the full grid goes into the dirty history, every chain buffer is repainted at the new level in turn
+		bool resized = m_renderWidth != m_dirtyTiles.GetWidth() || m_renderHeight != m_dirtyTiles.GetHeight();
+		bool fullFrame = !m_frameValid || !m_tileUpdates || resized
+			|| m_threadMode == THREAD_MULTI_FRAGMENT
+			|| m_tex.get() != m_lastTex
+			|| m_clearColor != m_lastClearColor
+			|| m_quality.level != m_lastQualityLevel;
+		m_dirtyTiles.Resize(m_renderWidth, m_renderHeight);
+		m_dirtyTiles.Clear();
+		if (resized)
 		{
-			for (int i = 0; i < THREAD_COUNT; i++)
-				m_rasterizers[i]->BeginTasks();
-		}
-		else if (m_threadMode == THREAD_MULTI_FRAGMENT)
-		{
-			m_rasterizerManager->BeginTask();
+			for (size_t i = 0; i < m_dirtyHistory.size(); i++)
+			{
+				m_dirtyHistory[i].Resize(m_renderWidth, m_renderHeight);
+				m_dirtyHistory[i].SetAll();
+			}
 		}
-
-		DirectXHelper::Instance()->Profile(GetTickCount(), L"Scene");
 		for (int idx = 0; idx < m_pipeDataVector.size(); idx++)
 		{
-			shared_ptr<PipeLineData>& pipeData = m_pipeDataVector[idx];
+			PipeLineData* pipeData = m_pipeDataVector[idx].get();
 			VertexBufferObject* vbo = m_vboVector[idx].get();
-			for (int i = 0; i < pipeData->capacity; i++)
+			if (m_uniformBlocks[idx] == nullptr)
+				continue;
+			//a static draw under a static camera keeps its transformed vertices and culled triangles
+			bool dirty = !pipeData->verticesValid
+				|| pipeData->vboVersion != vbo->GetVersion()
+				|| pipeData->uniformVersion != m_uniformVersions[idx]
+				|| pipeData->transformedInstanceVersion != pipeData->instanceVersion
+				|| pipeData->transformedRectVersion != pipeData->rectVersion
+				|| pipeData->viewportWidth != m_renderWidth
+				|| pipeData->viewportHeight != m_renderHeight;
+			if (dirty)
 			{
-				VertexProcessor& cur_vp = pipeData->vp[i];
-				const uint32* colorptr = nullptr;
-				if (vbo->useIndex())
-				{
-					colorptr = vbo->GetColor(vbo->GetIndex(i));
-					cur_vp.pos = vbo->GetPos(vbo->GetIndex(i));
-				}
-				else
-				{
-					colorptr = vbo->GetColor(i);
-					cur_vp.pos = vbo->GetPos(i);
-				}
-				if (colorptr != nullptr)
-					cur_vp.color = colorptr;
-				else
-					cur_vp.color = (uint32*)this;//ɫ
-				cur_vp.normal = vbo->GetNormal(i);
-
-				if (vbo->hasUV())
-					cur_vp.vs_out.uv = *(vbo->GetUV(i));
-
-				cur_vp.vs_out.vertexID = i;
-				cur_vp.vs_out.triangleID = i / 3;
-				cur_vp.vs_out.instanceID = idx;
-
-				//cur_vp.vs_out.uv[0] = 1.0 - cur_vp.vs_out.uv[0];
-				cur_vp.vs_out.uv[1] = 1.0 - cur_vp.vs_out.uv[1];//ԴuvǴ½ǿʼ㣬ߵuvϿʼ㣬·ת
-
-				cur_vp.uniforms = m_UniformVector[idx];
-				cur_vp.Process();//һͼ任ͶӰ任
-
-				//w
-				float rhw = 1.0f / cur_vp.vs_out.pos[3];
-				cur_vp.vs_out.pos[0] *= rhw;
-				cur_vp.vs_out.pos[1] *= rhw;
-				cur_vp.vs_out.pos[2] *= rhw;
-				cur_vp.vs_out.pos[3] = 1.0f;
-				cur_vp.vs_out.rhw = rhw;
-
-				cur_vp.vs_out.pos[0] = (cur_vp.vs_out.pos[0] + 1.0f) * 0.5f * m_width;
-				cur_vp.vs_out.pos[1] = (cur_vp.vs_out.pos[1] + 1.0f) * 0.5f * m_height;
-
-				cur_vp.vs_out.uv *= rhw;//uvwԺ˻Ϊȷuv
+				//where the draw was last frame has to be repainted as well as where it is now
+				m_dirtyTiles.Merge(pipeData->tileCoverage);
+				//the frame in flight may still be reading vp, this one is written into the other array
+				pipeData->vp.swap(pipeData->vpBack);
+				TransformVertices(idx);
+				CullTriangles(pipeData);
+				m_dirtyTiles.Merge(pipeData->tileCoverage);
+				pipeData->verticesValid = true;
+				pipeData->vboVersion = vbo->GetVersion();
+				pipeData->uniformVersion = m_uniformVersions[idx];
+				pipeData->transformedInstanceVersion = pipeData->instanceVersion;
+				pipeData->transformedRectVersion = pipeData->rectVersion;
+				pipeData->viewportWidth = m_renderWidth;
+				pipeData->viewportHeight = m_renderHeight;
 			}
-			DirectXHelper::Instance()->Profile(GetTickCount(), L"VP");
-			for (int i = 0; i < pipeData->capacity; i += 3)
+		}
+		DirectXHelper::Instance()->Profile(GetTickCount(), L"VP");
+
+		if (fullFrame)
+			m_dirtyTiles.SetAll();
+		m_frameValid = true;
+		m_lastTex = m_tex.get();
+		m_lastClearColor = m_clearColor;
+		m_lastQualityLevel = m_quality.level;
+
+		//the buffer this frame gets still holds the frame from GetCount() frames ago,
+		//so it is repainted wherever any of the frames since then changed;
+		//the grid of the frame in flight is still its tile mask, this one goes into the other
+		TileGrid& renderTiles = m_renderTiles[m_frameIndex & 1];
+		renderTiles = m_dirtyTiles;
+		if (m_frameChain)
+		{
+			m_dirtyHistory[m_frameIndex % m_dirtyHistory.size()] = m_dirtyTiles;
+			for (size_t i = 0; i < m_dirtyHistory.size(); i++)
+				renderTiles.Merge(m_dirtyHistory[i]);
+		}
+		m_frameIndex++;
+		const TileGrid* tileMask = fullFrame ? nullptr : &renderTiles;
+		BinTriangles(tileMask);
+		DirectXHelper::Instance()->Profile(GetTickCount(), L"Bin");
+		m_timings.frontMs = MillisecondsSince(m_frameCounter);
+
+		//everything above overlapped the raster of the last frame
+		FinishFrame();
+		DirectXHelper::Instance()->Profile(GetTickCount(), L"FP_wait");
+		StartFrame(renderTiles, tileMask);
+		DirectXHelper::Instance()->Profile(GetTickCount(), L"FP_push");
+	}
+
+	void Soft3dPipeline::BinTriangles(const TileGrid* tileMask)
+	{
+		m_bins.resize(m_threadMode == THREAD_MULTI_RASTERIZER ? THREAD_COUNT : 1);
+		for (size_t i = 0; i < m_bins.size(); i++)
+			m_bins[i].clear();
+		m_pendingVertices.clear();
+		for (int idx = 0; idx < m_pipeDataVector.size(); idx++)
+		{
+			PipeLineData* pipeData = m_pipeDataVector[idx].get();
+			if (m_uniformBlocks[idx] == nullptr)
+				continue;
+			//unchanged draws are only resubmitted for the tiles something else repaints
+			if (tileMask != nullptr && !pipeData->tileCoverage.Intersects(*tileMask))
+				continue;
+			//held until the raster of this frame is done, ReplaceVBO or SetInstances may drop them meanwhile
+			m_pendingVertices.push_back(pipeData->vp);
+			const vector<uint32>& triangles = pipeData->visibleTriangles;
+			const ClipRect& clip = pipeData->clip;
+			for (size_t t = 0; t < triangles.size(); t += 3)
 			{
-				VertexProcessor& vp1 = pipeData->vp[i];
-				VertexProcessor& vp2 = pipeData->vp[i + 1];
-				VertexProcessor& vp3 = pipeData->vp[i + 2];
-
-				VertexBufferObject::CULL_MODE cull_mode = VertexBufferObject::CULL_NONE;
-				//бѡ
-				vec4 a = vp1.vs_out.pos - vp2.vs_out.pos;
-				vec4 b = vp2.vs_out.pos - vp3.vs_out.pos;
-				vec3 c = vec3(a[0], a[1], a[2]);
-				vec3 d = vec3(b[0], b[1], b[2]);
-				vec3 r = cross(c, d);
-				if (r[2] < 0.0f)
-					cull_mode = VertexBufferObject::CULL_CW;
-				else if (r[2] > 0.0f)
-					cull_mode = VertexBufferObject::CULL_CCW;
-
-				if (pipeData->cullMode != VertexBufferObject::CULL_NONE && pipeData->cullMode != cull_mode)
-					continue;
-
-				//вü
-				if (vp1.vs_out.pos[2] < 0.0f
-					|| vp2.vs_out.pos[2] < 0.0f
-					|| vp3.vs_out.pos[2] < 0.0f)
-					continue;
-				//if (vp1.vs_out.pos[0] > m_width * 1.0f || vp1.vs_out.pos[1] > m_height * 1.0f
-				//	|| vp1.vs_out.pos[0] < 0 || vp1.vs_out.pos[1] < 0)
-				//	continue;
-				//if (vp2.vs_out.pos[0] > m_width * 1.0f || vp2.vs_out.pos[1] > m_height * 1.0f
-				//	|| vp2.vs_out.pos[0] < 0 || vp2.vs_out.pos[1] < 0)
-				//	continue;
-				//if (vp3.vs_out.pos[0] > m_width * 1.0f || vp3.vs_out.pos[1] > m_height * 1.0f
-				//	|| vp3.vs_out.pos[0] < 0 || vp3.vs_out.pos[1] < 0)
-				//	continue;
-
-				//make triangle always ccw sorting
-				uint32 index[3] = { i, i + 1, i + 2 };
-				if (cull_mode == VertexBufferObject::CULL_CW)
+				VS_OUT* vo0 = &(pipeData->vp[triangles[t]].vs_out);
+				VS_OUT* vo1 = &(pipeData->vp[triangles[t + 1]].vs_out);
+				VS_OUT* vo2 = &(pipeData->vp[triangles[t + 2]].vs_out);
+				if (tileMask != nullptr)
 				{
-					index[0] = i + 2;
-					index[2] = i;
+					int rect[4];
+					TriangleBounds(vo0, vo1, vo2, rect);
+					if (!clip.Clip(rect) || !tileMask->TestRect(rect[0], rect[1], rect[2], rect[3]))
+						continue;
 				}
+				vector<RasterizerTask>& bin = m_bins[(t / 3) % m_bins.size()];
 
 				switch (pipeData->renderMode)
 				{
 				case VertexBufferObject::RENDER_LINE:
-				{
-					if (m_threadMode == THREAD_MULTI_RASTERIZER)
-					{
-						m_rasterizers[(i/3)%THREAD_COUNT]->AddTask(RasterizerTask(&(pipeData->vp[index[0]].vs_out), &(pipeData->vp[index[1]].vs_out)));
-						m_rasterizers[(i/3)%THREAD_COUNT]->AddTask(RasterizerTask(&(pipeData->vp[index[1]].vs_out), &(pipeData->vp[index[2]].vs_out)));
-						m_rasterizers[(i/3)%THREAD_COUNT]->AddTask(RasterizerTask(&(pipeData->vp[index[2]].vs_out), &(pipeData->vp[index[0]].vs_out)));
-					}
-					else if (m_threadMode == THREAD_MULTI_FRAGMENT)
-					{
-						m_rasterizerManager->AddRasterizeTask(&(pipeData->vp[index[0]].vs_out), &(pipeData->vp[index[1]].vs_out), nullptr);
-						m_rasterizerManager->AddRasterizeTask(&(pipeData->vp[index[1]].vs_out), &(pipeData->vp[index[2]].vs_out), nullptr);
-						m_rasterizerManager->AddRasterizeTask(&(pipeData->vp[index[2]].vs_out), &(pipeData->vp[index[0]].vs_out), nullptr);
-					}
-					else
-					{
-						m_rasterizer->BresenhamLine(&(pipeData->vp[index[0]].vs_out), &(pipeData->vp[index[1]].vs_out));
-						m_rasterizer->BresenhamLine(&(pipeData->vp[index[1]].vs_out), &(pipeData->vp[index[2]].vs_out));
-						m_rasterizer->BresenhamLine(&(pipeData->vp[index[2]].vs_out), &(pipeData->vp[index[0]].vs_out));
-					}
-
+					bin.push_back(RasterizerTask(vo0, vo1, clip));
+					bin.push_back(RasterizerTask(vo1, vo2, clip));
+					bin.push_back(RasterizerTask(vo2, vo0, clip));
 					break;
-				}
-
 				case VertexBufferObject::RENDER_TRIANGLE:
-				{
-					if (m_threadMode == THREAD_MULTI_RASTERIZER)
-					{
-						m_rasterizers[(i/3)%THREAD_COUNT]->AddTask(RasterizerTask(&(pipeData->vp[index[0]].vs_out), &(pipeData->vp[index[1]].vs_out), &(pipeData->vp[index[2]].vs_out)));
-					}
-					else if (m_threadMode == THREAD_MULTI_FRAGMENT)
-					{
-						m_rasterizerManager->AddRasterizeTask(&(pipeData->vp[index[0]].vs_out), &(pipeData->vp[index[1]].vs_out), &(pipeData->vp[index[2]].vs_out));
-					}
-					else
-					{
-						m_rasterizer->Triangle(&(pipeData->vp[index[0]].vs_out), &(pipeData->vp[index[1]].vs_out), &(pipeData->vp[index[2]].vs_out));
-					}
+					bin.push_back(RasterizerTask(vo0, vo1, vo2, clip));
 					break;
-				}
-
 				default:
 					break;
 				}
 			}
-			DirectXHelper::Instance()->Profile(GetTickCount(), L"FP_push");
 		}
+	}
+
+	void Soft3dPipeline::FinishFrame()
+	{
+		if (!m_frameInFlight)
+			return;
+		m_frameInFlight = false;
 		if (m_threadMode == THREAD_MULTI_RASTERIZER)
 		{
 			for (int i = 0; i < THREAD_COUNT; i++)
@@ -342,13 +618,117 @@ namespace soft3d
 		{
 			m_rasterizerManager->EndTask();
 		}
-		DirectXHelper::Instance()->Profile(GetTickCount(), L"FP_wait");
+		//tiles cleared but never drawn into get their color before the frame is presented
+		Rasterizer::ResolveClears();
+		//the single thread mode rasterized inline, StartFrame timed it
+		if (m_threadMode != THREAD_ONE)
+			m_timings.rasterMs = MillisecondsSince(m_rasterCounter);
 
+		//the present thread copies this frame out while the next one renders into another buffer
 		if (m_threadMode == THREAD_MULTI_FRAGMENT)
 			DirectXHelper::Instance()->Paint(m_rasterizerManager->GetFrameBuffer(), m_width, m_height);
 		else
-			DirectXHelper::Instance()->Paint(Rasterizer::GetFrameBuffer(), m_width, m_height);
-		DirectXHelper::Instance()->Profile(GetTickCount(), L"BLT");
+			m_frameChain->Present(m_rasterWidth, m_rasterHeight);
+		m_inFlightVertices.clear();
+		m_rasterTex.reset();
+	}
+
+	void Soft3dPipeline::StartFrame(const TileGrid& renderTiles, const TileGrid* tileMask)
+	{
+		m_inFlightVertices.swap(m_pendingVertices);
+		m_rasterTex = m_tex;
+		m_rasterQuality = m_quality;
+		if (m_frameChain)
+			Rasterizer::BindFrameBuffer(m_frameChain->Acquire());
+		m_rasterWidth = m_renderWidth;
+		m_rasterHeight = m_renderHeight;
+		for (size_t i = 0; i < m_rasterizers.size(); i++)
+			m_rasterizers[i]->Resize(m_rasterWidth, m_rasterHeight);
+		if (m_rasterizer)
+			m_rasterizer->Resize(m_rasterWidth, m_rasterHeight);
+		QueryPerformanceCounter(&m_rasterCounter);
+
+		//every rasterizer shares one frame buffer, clearing it once is enough
+		if (m_threadMode == THREAD_MULTI_RASTERIZER)
+		{
+			m_rasterizers[0]->ClearTiles(renderTiles, m_clearColor);
+			for (int i = 0; i < THREAD_COUNT; i++)
+			{
+				m_rasterizers[i]->SetTileMask(tileMask);
+				m_rasterizers[i]->BeginTasks();
+				m_rasterizers[i]->AddTasks(m_bins[i]);
+			}
+		}
+		else if (m_threadMode == THREAD_MULTI_FRAGMENT)
+		{
+			m_rasterizerManager->Clear(m_clearColor);
+			m_rasterizerManager->BeginTask();
+			vector<RasterizerTask>& bin = m_bins[0];
+			for (size_t i = 0; i < bin.size(); i++)
+				m_rasterizerManager->AddRasterizeTask(bin[i].m_vo[0], bin[i].m_vo[1], bin[i].m_vo[2], bin[i].m_clip);
+		}
+		else
+		{
+			m_rasterizer->ClearTiles(renderTiles, m_clearColor);
+			m_rasterizer->SetTileMask(tileMask);
+			vector<RasterizerTask>& bin = m_bins[0];
+			for (size_t i = 0; i < bin.size(); i++)
+			{
+				if (bin[i].m_vo[2] == nullptr)
+					m_rasterizer->BresenhamLine(bin[i].m_vo[0], bin[i].m_vo[1], bin[i].m_clip);
+				else
+					m_rasterizer->Triangle(bin[i].m_vo[0], bin[i].m_vo[1], bin[i].m_vo[2], bin[i].m_clip);
+			}
+		}
+		if (m_threadMode == THREAD_ONE)
+			m_timings.rasterMs = MillisecondsSince(m_rasterCounter);
+		m_frameInFlight = true;
+	}
+
+	void Soft3dPipeline::SetDynamicResolution(float targetMs, float minScale)
+	{
+		//the fragment threads present their own buffer, there is nothing to scale it up
+		if (m_threadMode == THREAD_MULTI_FRAGMENT)
+			return;
+		m_renderScale.SetTarget(targetMs, minScale);
+	}
+
+	void Soft3dPipeline::SetFrameBudget(float budgetMs)
+	{
+		//the fragment threads shade through RasterizerManager, which has no knobs to turn down
+		if (m_threadMode == THREAD_MULTI_FRAGMENT)
+			return;
+		m_qualityGovernor.SetBudget(budgetMs);
+		m_quality = m_qualityGovernor.GetKnobs();
+	}
+
+	float Soft3dPipeline::MillisecondsSince(const LARGE_INTEGER& since)
+	{
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		if (since.QuadPart == 0 || m_counterFrequency.QuadPart == 0)
+			return 0.0f;
+		return (float)((now.QuadPart - since.QuadPart) * 1000.0 / m_counterFrequency.QuadPart);
+	}
+
+	void Soft3dPipeline::UpdateGovernors()
+	{
+		m_timings.frameMs = MillisecondsSince(m_frameCounter);
+		QueryPerformanceCounter(&m_frameCounter);
+
+		//the frame time covers the whole loop, present included, so what is kept is the pace frames come out at;
+		//the render scale reacts within a frame or two, the quality knobs only to a lasting miss
+		float scale = m_renderScale.Update(m_timings.frameMs);
+		m_renderWidth = std::max<uint16>((uint16)(m_width * scale + 0.5f), std::min<uint16>(m_width, 8));
+		m_renderHeight = std::max<uint16>((uint16)(m_height * scale + 0.5f), std::min<uint16>(m_height, 8));
+		m_quality = m_qualityGovernor.Update(m_timings);
+
+		if (m_renderScale.IsEnabled() || m_qualityGovernor.GetBudget() > 0.0f)
+		{
+			wchar_t status[64];
+			swprintf(status, 64, L"Q%u %ux%u", m_quality.level, m_renderWidth, m_renderHeight);
+			DirectXHelper::Instance()->SetStatus(status);
+		}
 	}
 
 	void Soft3dPipeline::LoseFocus()
@@ -368,7 +748,11 @@ namespace soft3d
 
 	void Soft3dPipeline::Quit()
 	{
-		m_rasterizerManager->Quit();
+		FinishFrame();
+		if (m_frameChain)
+			m_frameChain->Flush();
+		if (m_rasterizerManager)
+			m_rasterizerManager->Quit();
 	}
 
 }
\ No newline at end of file
@@ -6,6 +6,12 @@
 #include "VertexBufferObject.h"
 #include "Texture.h"
 #include "VertexProcessor.h"
+#include "RasterizerTask.h"
+#include "FrameArena.h"
+#include "TileGrid.h"
+#include "FrameBufferChain.h"
+#include "RenderScale.h"
+#include "QualityGovernor.h"
 #include <boost/shared_array.hpp>
 #include <boost/function.hpp>
 #include <dinput.h>
@@ -14,32 +20,60 @@ namespace soft3d
 {
 	class Rasterizer;
 	class RasterizerManager;
+
+	//rect in window pixels with a lower left origin like the rasterizer, empty stands for the whole window
+	struct DrawRect
+	{
+		int x = 0;
+		int y = 0;
+		int width = 0;
+		int height = 0;
+
+		inline bool IsEmpty() const {
+			return width <= 0 || height <= 0;
+		}
+		inline bool operator!=(const DrawRect& other) const {
+			return x != other.x || y != other.y || width != other.width || height != other.height;
+		}
+	};
+
 	struct PipeLineData
 	{
 		boost::shared_array<VertexProcessor> vp;
+		boost::shared_array<VertexProcessor> vpBack;//the other half of vp, the vertex stage swaps them so it never writes what the frame in flight reads
 
 		VertexBufferObject::CULL_MODE cullMode;
 		VertexBufferObject::RENDER_MODE renderMode;
-		uint32 capacity;
+		uint32 capacity;//vertexCount * instanceCount processors in vp, instance by instance
+		uint32 vertexCount;
+		uint32 instanceCount;//1 for a plain draw
+
+		std::vector<vmath::mat4> instanceMatrices;//model matrix of every instance, empty for a plain draw
+		std::vector<uint32> instanceColors;//optional tint of every instance
+		std::vector<vmath::mat4> instanceMV;//mv uniform * model matrix, rebuilt with the vertices
+		uint32 instanceVersion = 0;//bumped by SetInstances when the matrices or colors change
+
+		DrawRect viewport;//ndc maps onto it and nothing is drawn outside of it
+		DrawRect scissor;//confines the draw further, empty for no scissor
+		uint32 rectVersion = 0;//bumped by SetViewport and SetScissor when either changes
+
+		//what vp was transformed with, the vertex stage is skipped while all of it still matches
+		bool verticesValid = false;
+		uint32 vboVersion = 0;
+		uint32 uniformVersion = 0;
+		uint32 transformedInstanceVersion = 0;
+		uint32 transformedRectVersion = 0;
+		uint16 viewportWidth = 0;
+		uint16 viewportHeight = 0;
+		std::vector<uint32> visibleTriangles;//vp indices of the triangles that survived culling, ccw ordered, rebuilt with vp
+		TileGrid tileCoverage;//tiles the visible triangles touch, kept until the next rebuild to clear the old bounds
+		ClipRect clip;//viewport and scissor in render pixels within the screen, rebuilt with vp
 	};
 
-	typedef void* UniformPtr;
-	typedef UniformPtr* UniformStack;
-
 	typedef char DIKEYBOARD[256];
 	typedef boost::function<void(const DIMOUSESTATE& dimouse)> MOUSE_EVENT_CB;
 	typedef boost::function<void(const DIKEYBOARD& dikeyboard)> KEYBOARD_EVENT_CB;
 
-	enum UNIFORM_LABEL
-	{
-		UNIFORM_MV_MATRIX = 0,
-		UNIFORM_PROJ_MATRIX,
-		UNIFORM_VIEW_MATRIX,
-
-		UNIFORM_LIGHT_DIR = 14,
-		UNIFORM_LIGHT_POS = 15,
-	};
-
 	class Soft3dPipeline
 	{
 	public:
@@ -50,13 +84,31 @@ namespace soft3d
 		~Soft3dPipeline();
 		void InitPipeline(HINSTANCE hInstance, HWND hwnd, uint16 width, uint16 height);
 		int SetVBO(std::shared_ptr<VertexBufferObject> vbo);
+		//swaps the vbo of an existing slot, its uniforms are kept; call between frames
+		void ReplaceVBO(uint32 vboIndex, std::shared_ptr<VertexBufferObject> vbo);
 		void SelectVBO(uint32 vboIndex);
-		void SetUniform(uint16 index, void* uniform);
+		//copies the block into this frame's arena and binds it to the current vbo until it is replaced,
+		//a vbo without uniforms is skipped
+		void SetUniforms(const DefaultUniforms& uniforms);
+		//draws the current vbo once per matrix, the mv_matrix uniform is applied on top of each of them;
+		//colors, when given, tint every instance; a count of 0 goes back to a single plain draw
+		void SetInstances(const vmath::mat4* matrices, uint32 count, const uint32* colors = nullptr);
 		void SetTexture(std::shared_ptr<Texture> tex);
+		//the current vbo is drawn into this part of the window only, ndc spanning it; 0 size goes back to the whole window
+		void SetViewport(int x, int y, int width, int height);
+		//cuts the current vbo down to a rect in window pixels on top of its viewport, 0 size turns it off;
+		//either only costs the pixels and tiles inside it
+		void SetScissor(int x, int y, int width, int height);
+		//texture of the frame being rasterized, SetTexture takes effect with the next frame
 		const Texture* CurrentTex() {
-			return m_tex.get();
+			return m_rasterTex.get();
+		}
+		//quality knobs of the frame being rasterized, latched with its texture
+		const QualityKnobs& CurrentQuality() {
+			return m_rasterQuality;
 		}
 		void Process();
+		//color of the tiles re-rendered this frame, a change of it redraws the whole frame
 		int Clear(uint32 color);
 
 		//input
@@ -71,6 +123,18 @@ namespace soft3d
 
 		inline uint16 GetWidth() { return m_width; }
 		inline uint16 GetHeight() { return m_height; }
+		//size the frame being prepared is rasterized at, below GetWidth * GetHeight under dynamic resolution
+		inline uint16 GetRenderWidth() { return m_renderWidth; }
+		inline uint16 GetRenderHeight() { return m_renderHeight; }
+		//lowers the render size, down to minScale of the window on each side, while frames take longer than targetMs
+		//and scales the frames back up on present; 0 renders at the full size again. rasterizer modes only
+		void SetDynamicResolution(float targetMs, float minScale = 0.5f);
+		//steps filtering, lighting, mip bias and shading rate down while frames take longer than budgetMs
+		//and back up once they are well within it; 0 keeps full quality. rasterizer modes only
+		void SetFrameBudget(float budgetMs);
+		//telemetry: knobs of the frame being prepared and the timings of the last one they were picked from
+		inline const QualityKnobs& GetQuality() { return m_quality; }
+		inline const FrameTimings& GetFrameTimings() { return m_timings; }
 
 		void Quit();
 
@@ -87,10 +151,65 @@ namespace soft3d
 		std::shared_ptr<Rasterizer> m_rasterizer;
 		std::vector<std::shared_ptr<Rasterizer>> m_rasterizers;
 		std::vector<std::shared_ptr<PipeLineData> > m_pipeDataVector;
-		std::vector<UniformStack> m_UniformVector;
+		std::vector<const DefaultUniforms*> m_uniformBlocks;
+		std::vector<uint32> m_uniformVersions;//bumped by SetUniforms only when the block contents change
+		//uniform blocks of this frame and the last one, the older arena is reset when a frame starts
+		FrameArena m_uniformArena[2];
+		uint32 m_arenaIndex = 0;
+		void BeginFrame();
+		std::shared_ptr<PipeLineData> CreatePipeLineData(const VertexBufferObject* vbo);
+		void AllocateVertexProcessors(PipeLineData* pd);
+		//vertex stage of one slot into its vp, then the culled and ccw ordered triangle list
+		void TransformVertices(uint32 idx);
+		void CullTriangles(PipeLineData* pd);
+		//inclusive render pixel rect of a window rect, the whole frame for an empty one
+		void RenderRect(const DrawRect& rect, int* out);
+
+		//two frames are in flight: the next frame runs its scene update, vertex stage and binning
+		//while the rasterizers still shade the last one, which is waited on and presented right before
+		//the next one is handed over
+		void BinTriangles(const TileGrid* tileMask);
+		void FinishFrame();
+		void StartFrame(const TileGrid& renderTiles, const TileGrid* tileMask);
+		//picks the render size and quality knobs of the next frame from the timings of the last one
+		void UpdateGovernors();
+		float MillisecondsSince(const LARGE_INTEGER& since);
+		std::vector<std::vector<RasterizerTask> > m_bins;//one per rasterizer thread
+		std::vector<boost::shared_array<VertexProcessor> > m_pendingVertices;//vertex outputs the binned frame reads
+		std::vector<boost::shared_array<VertexProcessor> > m_inFlightVertices;//and those of the frame in flight
+		std::shared_ptr<Texture> m_rasterTex;
+		bool m_frameInFlight = false;
+
+		//only tiles touched by a changed draw, in its old or new bounds, are cleared and rasterized again;
+		//any other change that affects every pixel redraws the whole frame
+		TileGrid m_dirtyTiles;
+		//dirty tiles of the last frames, one per chain buffer; a buffer is behind by all of them
+		std::vector<TileGrid> m_dirtyHistory;
+		TileGrid m_renderTiles[2];//tile masks of the frame in flight and the one being prepared
+		uint32 m_frameIndex = 0;
+		std::shared_ptr<FrameBufferChain> m_frameChain;//rasterizer modes only, the fragment threads own their buffer
+		uint32 FRAME_BUFFER_COUNT = 2;
+		uint32 m_clearColor = 0;
+		uint32 m_lastClearColor = 0;
+		const Texture* m_lastTex = nullptr;
+		uint32 m_lastQualityLevel = 0;
+		bool m_frameValid = false;
+		bool m_tileUpdates = true;
 
 		uint16 m_width;
 		uint16 m_height;
+		uint16 m_renderWidth;
+		uint16 m_renderHeight;
+		uint16 m_rasterWidth = 0;//render size of the frame in flight
+		uint16 m_rasterHeight = 0;
+		RenderScale m_renderScale;
+		QualityGovernor m_qualityGovernor;
+		QualityKnobs m_quality;
+		QualityKnobs m_rasterQuality;
+		FrameTimings m_timings;
+		LARGE_INTEGER m_frameCounter;//start of the last frame, 0 after a pause
+		LARGE_INTEGER m_rasterCounter;//hand over of the frame in flight
+		LARGE_INTEGER m_counterFrequency;
 
 		LPDIRECTINPUT8 m_pDirectInput;
 		LPDIRECTINPUTDEVICE8 m_pMouseDevice;
@@ -112,11 +231,4 @@ namespace soft3d
 		int THREAD_COUNT = 7;
 	};
 
-	template<typename T>
-	void SetUniform(uint16 index, const T& val)
-	{
-		T* p = new T(val);
-		Soft3dPipeline::Instance()->SetUniform(index, (void*)p);
-	}
-
 }
\ No newline at end of file
@@ -1,8 +1,25 @@
 #include "soft3d.h"
 #include "Texture.h"
+#include "MappedFile.h"
+#include <emmintrin.h>
+#include <atomic>
+#include <malloc.h>
 
 namespace soft3d
 {
+	//every upload gets a new id, so a texture reallocated at the same address never hits stale cache lines
+	static std::atomic<uint32> s_uploadID(0);
+
+	//level storage starts on a cache line, so every 4x4 tile and every run of BC1 blocks is one line
+	static inline uint32* AllocateLevel(size_t texels)
+	{
+		return (uint32*)_aligned_malloc(texels * sizeof(uint32), 64);
+	}
+
+	static inline void FreeLevel(uint32* data)
+	{
+		_aligned_free(data);
+	}
 
 	Texture::Texture()
 	{
@@ -12,110 +29,576 @@ namespace soft3d
 
 	Texture::~Texture()
 	{
+		ReleaseLevels();
 	}
 
 
-	void Texture::CopyFromBuffer(const uint32* buf, int width, int height)
+	void Texture::CopyFromBuffer(const uint32* buf, int width, int height, LAYOUT layout, FORMAT format)
 	{
-		m_data = new uint32[width * height];
+		ReleaseLevels();
+		m_data = AllocateLevel(width * height);
 		memcpy(m_data, buf, width * height * sizeof(uint32));
 		m_width = width;
 		m_height = height;
+
+		MipLevel level0 = { m_data, m_width, m_height, 0, 0 };
+		m_levels.push_back(level0);
+		m_layout = LAYOUT_LINEAR;
+		m_format = FORMAT_BGRA8;
+		m_pow2 = (width & (width - 1)) == 0 && (height & (height - 1)) == 0;
+		GenerateMipmaps();
+		if (format == FORMAT_BC1)
+			CompressLevels();
+		else if (layout == LAYOUT_TILED)
+			SwizzleLevels();
+		m_data = m_levels[0].data;
 	}
 
-	float floor(float value)
+	void Texture::ReleaseLevels()
 	{
-		return (float)(uint32)value;
+		//levels of a cached texture live in the mapping and go away with it
+		if (!m_mapping)
+		{
+			for (size_t i = 0; i < m_levels.size(); i++)
+				FreeLevel(m_levels[i].data);
+		}
+		m_mapping.reset();
+		m_levels.clear();
+		m_data = nullptr;
 	}
 
-	float frac(float value)
+	void Texture::GenerateMipmaps()
 	{
-		return value - floor(value);
+		//2x2 box filter down to 1x1, odd edges reuse the last row/column
+		while (m_levels.back().width > 1 || m_levels.back().height > 1)
+		{
+			const MipLevel& src = m_levels.back();
+			MipLevel dst;
+			dst.width = std::max<uint16>(src.width / 2, 1);
+			dst.height = std::max<uint16>(src.height / 2, 1);
+			dst.tileStride = 0;
+			dst.key = 0;
+			dst.data = AllocateLevel(dst.width * dst.height);
+			for (uint32 y = 0; y < dst.height; y++)
+			{
+				uint32 y0 = std::min<uint32>(y * 2, src.height - 1);
+				uint32 y1 = std::min<uint32>(y * 2 + 1, src.height - 1);
+				for (uint32 x = 0; x < dst.width; x++)
+				{
+					uint32 x0 = std::min<uint32>(x * 2, src.width - 1);
+					uint32 x1 = std::min<uint32>(x * 2 + 1, src.width - 1);
+					uint32 c0 = src.data[x0 + src.width * y0];
+					uint32 c1 = src.data[x1 + src.width * y0];
+					uint32 c2 = src.data[x0 + src.width * y1];
+					uint32 c3 = src.data[x1 + src.width * y1];
+					//B,R and G,A are averaged two channels at a time
+					uint32 rb = (c0 & 0x00ff00ff) + (c1 & 0x00ff00ff) + (c2 & 0x00ff00ff) + (c3 & 0x00ff00ff) + 0x00020002;
+					uint32 ag = ((c0 >> 8) & 0x00ff00ff) + ((c1 >> 8) & 0x00ff00ff) + ((c2 >> 8) & 0x00ff00ff) + ((c3 >> 8) & 0x00ff00ff) + 0x00020002;
+					dst.data[x + dst.width * y] = ((rb >> 2) & 0x00ff00ff) | (((ag >> 2) & 0x00ff00ff) << 8);
+				}
+			}
+			m_levels.push_back(dst);
+		}
 	}
 
-	Color Texture::Sampler2D(const vmath::vec2* uv) const
+	static inline uint32 LerpColor(uint32 c0, uint32 c1, uint32 w)
 	{
-		switch (filter_mode)
+		//w is the 8 bit weight of c1, B,R and G,A are blended two channels per multiply
+		uint32 iw = 256 - w;
+		uint32 rb = ((c0 & 0x00ff00ff) * iw + (c1 & 0x00ff00ff) * w) >> 8;
+		uint32 ag = ((c0 >> 8) & 0x00ff00ff) * iw + ((c1 >> 8) & 0x00ff00ff) * w;
+		return (rb & 0x00ff00ff) | (ag & 0xff00ff00);
+	}
+
+	void Texture::SwizzleLevels()
+	{
+		//mips are built on the linear layout, then every level is reordered into 4x4 tiles;
+		//padding texels repeat the edge so partial tiles stay well defined
+		for (size_t i = 0; i < m_levels.size(); i++)
 		{
-		case BILINEAR:
-			return Sampler2D_bilinear(uv);
-		case NEAREST:
-			return Sampler2D_nearest(uv);
-		default:
-			return Sampler2D_bilinear(uv);
+			MipLevel& level = m_levels[i];
+			uint32 tileStride = (level.width + 3) / 4;
+			uint32 tileRows = (level.height + 3) / 4;
+			uint32* tiled = AllocateLevel(tileStride * tileRows * 16);
+			for (uint32 y = 0; y < tileRows * 4; y++)
+			{
+				uint32 sy = std::min<uint32>(y, level.height - 1);
+				for (uint32 x = 0; x < tileStride * 4; x++)
+				{
+					uint32 sx = std::min<uint32>(x, level.width - 1);
+					tiled[(((y >> 2) * tileStride + (x >> 2)) << 4) + ((y & 3) << 2) + (x & 3)] = level.data[sx + level.width * sy];
+				}
+			}
+			FreeLevel(level.data);
+			level.data = tiled;
+			level.tileStride = tileStride;
 		}
+		m_layout = LAYOUT_TILED;
+	}
+
+	size_t Texture::LevelSize(const MipLevel& level) const
+	{
+		uint32 tileRows = (level.height + 3) / 4;
+		if (m_format == FORMAT_BC1)
+			return level.tileStride * tileRows * 2 * sizeof(uint32);
+		if (m_layout == LAYOUT_TILED)
+			return level.tileStride * tileRows * 16 * sizeof(uint32);
+		return level.width * level.height * sizeof(uint32);
+	}
+
+	size_t Texture::GetMemorySize() const
+	{
+		size_t size = 0;
+		for (size_t i = 0; i < m_levels.size(); i++)
+			size += LevelSize(m_levels[i]);
+		return size;
+	}
+
+	struct TextureCacheHeader
+	{
+		enum { MAGIC = 0x58543353, VERSION = 1 };//"S3TX"
+		uint32 magic;
+		uint32 version;
+		uint64 stamp;
+		uint32 layout;
+		uint32 format;
+		uint32 pow2;
+		uint32 levelCount;
+	};
+
+	struct TextureCacheLevel
+	{
+		uint64 offset;//from the start of the file, 64 byte aligned
+		uint64 size;
+		uint16 width;
+		uint16 height;
+		uint16 tileStride;
+		uint16 pad;
+	};
+
+	static inline uint64 AlignCacheOffset(uint64 offset)
+	{
+		return (offset + 63) & ~(uint64)63;
 	}
 
-	Color Texture::Sampler2D_nearest(const vmath::vec2* uv) const
+	bool Texture::SaveCache(const char* filename, uint64 stamp) const
 	{
-		uint32 u = (uint32)(m_width * (*uv)[0]);
-		uint32 v = (uint32)(m_height * (*uv)[1]);
-		if (u >= m_width)
-			u = m_width - 1;
-		if (v >= m_height)
-			v = m_height - 1;
-		return Color(m_data[u + m_width * v]);
+		if (m_levels.empty())
+			return false;
+
+		TextureCacheHeader header = {};
+		header.magic = TextureCacheHeader::MAGIC;
+		header.version = TextureCacheHeader::VERSION;
+		header.stamp = stamp;
+		header.layout = m_layout;
+		header.format = m_format;
+		header.pow2 = m_pow2;
+		header.levelCount = m_levels.size();
+
+		std::vector<TextureCacheLevel> table(m_levels.size());
+		uint64 offset = AlignCacheOffset(sizeof(header) + sizeof(TextureCacheLevel) * table.size());
+		for (size_t i = 0; i < m_levels.size(); i++)
+		{
+			TextureCacheLevel& entry = table[i];
+			entry.offset = offset;
+			entry.size = LevelSize(m_levels[i]);
+			entry.width = m_levels[i].width;
+			entry.height = m_levels[i].height;
+			entry.tileStride = m_levels[i].tileStride;
+			entry.pad = 0;
+			offset = AlignCacheOffset(offset + entry.size);
+		}
+
+		FILE* file = fopen(filename, "wb");
+		if (file == nullptr)
+			return false;
+		static const char zeros[64] = {};
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+			&& fwrite(&table[0], sizeof(TextureCacheLevel), table.size(), file) == table.size();
+		uint64 written = sizeof(header) + sizeof(TextureCacheLevel) * table.size();
+		for (size_t i = 0; ok && i < m_levels.size(); i++)
+		{
+			ok = fwrite(zeros, 1, (size_t)(table[i].offset - written), file) == table[i].offset - written
+				&& fwrite(m_levels[i].data, 1, (size_t)table[i].size, file) == table[i].size;
+			written = table[i].offset + table[i].size;
+		}
+		ok = fclose(file) == 0 && ok;
+		if (!ok)
+			remove(filename);
+		return ok;
 	}
 
-	Color Texture::Sampler2D_bilinear(const vmath::vec2* uv) const
+	bool Texture::LoadCache(const char* filename, uint64 stamp)
 	{
-		vmath::vec2 uv_offset = *uv + vmath::vec2(0.5 / (float)m_width, 0.5 / (float)m_height);
-		vmath::uvec2 uv0, uv1, uv2, uv3;
-		vmath::vec2 uv_clamp = vmath::clamp<float, 2>(uv_offset, vmath::vec2(0), vmath::vec2(1));
-		uv0[0] = (uint32)((m_width - 1) * uv_clamp[0]);
-		uv0[1] = (uint32)((m_height - 1) * uv_clamp[1]);
+		std::shared_ptr<MappedFile> mapping(new MappedFile());
+		if (!mapping->Open(filename) || mapping->GetSize() < sizeof(TextureCacheHeader))
+			return false;
 
-		float fu = ((m_width-1) * uv_clamp[0]);
-		float fv = ((m_height-1) * uv_clamp[1]);
-		float a = frac(fu);
-		float b = frac(fv);
-		if (a > 0.5f)
+		const char* base = (const char*)mapping->GetData();
+		const TextureCacheHeader* header = (const TextureCacheHeader*)base;
+		if (header->magic != TextureCacheHeader::MAGIC || header->version != TextureCacheHeader::VERSION
+			|| header->stamp != stamp || header->levelCount == 0
+			|| sizeof(TextureCacheHeader) + sizeof(TextureCacheLevel) * (uint64)header->levelCount > mapping->GetSize())
+			return false;
+
+		const TextureCacheLevel* table = (const TextureCacheLevel*)(base + sizeof(TextureCacheHeader));
+		for (uint32 i = 0; i < header->levelCount; i++)
 		{
-			uv1[0] = uv0[0] + 1;
-			uv1[1] = uv0[1];
+			if (table[i].offset + table[i].size > mapping->GetSize() || (table[i].offset & 63) != 0)
+				return false;
 		}
-		else
+
+		ReleaseLevels();
+		m_layout = (LAYOUT)header->layout;
+		m_format = (FORMAT)header->format;
+		m_pow2 = header->pow2 != 0;
+		//the decoded block cache is keyed per upload, a mapped texture counts as a fresh one
+		uint32 id = ++s_uploadID;
+		m_mapping = mapping;
+		for (uint32 i = 0; i < header->levelCount; i++)
 		{
-			uv1[0] = uv0[0] > 0 ? uv0[0] - 1 : uv0[0];
-			uv1[1] = uv0[1];
+			//the mapping is read only, sampling never writes to level data
+			MipLevel level = { (uint32*)(base + table[i].offset), table[i].width, table[i].height, table[i].tileStride, 0 };
+			if (m_format == FORMAT_BC1)
+				level.key = (id << 5) | i;
+			if (LevelSize(level) != table[i].size)
+			{
+				ReleaseLevels();
+				return false;
+			}
+			m_levels.push_back(level);
 		}
-		if (b > 0.5)
+		m_width = m_levels[0].width;
+		m_height = m_levels[0].height;
+		m_data = m_levels[0].data;
+		return true;
+	}
+
+	static inline uint32 Pack565(uint32 c)
+	{
+		return ((c >> 8) & 0xf800) | ((c >> 5) & 0x07e0) | ((c >> 3) & 0x001f);
+	}
+
+	static inline uint32 Unpack565(uint32 c)
+	{
+		uint32 r = (c >> 11) & 0x1f;
+		uint32 g = (c >> 5) & 0x3f;
+		uint32 b = c & 0x1f;
+		return 0xff000000 | ((r << 3 | r >> 2) << 16) | ((g << 2 | g >> 4) << 8) | (b << 3 | b >> 2);
+	}
+
+	static inline void BC1Palette(uint32 c0, uint32 c1, uint32* palette)
+	{
+		palette[0] = Unpack565(c0);
+		palette[1] = Unpack565(c1);
+		if (c0 > c1)
 		{
-			uv2[0] = uv0[0];
-			uv2[1] = uv0[1] + 1;
-			uv3[0] = uv1[0];
-			uv3[1] = uv1[1] + 1;
+			palette[2] = LerpColor(palette[0], palette[1], 85);
+			palette[3] = LerpColor(palette[0], palette[1], 171);
 		}
 		else
 		{
-			uv2[0] = uv0[0];
-			uv2[1] = uv0[1] > 0 ? uv0[1] - 1 : uv0[1];
-			uv3[0] = uv1[0];
-			uv3[1] = uv1[1] > 0 ? uv1[1] - 1 : uv1[1];
+			palette[2] = LerpColor(palette[0], palette[1], 128);
+			palette[3] = 0xff000000;
 		}
-		Color c[4];
-		c[0] = m_data[uv0[0] + m_width * uv0[1]];
-		c[1] = m_data[uv1[0] + m_width * uv1[1]];
-		c[2] = m_data[uv2[0] + m_width * uv2[1]];
-		c[3] = m_data[uv3[0] + m_width * uv3[1]];
-		if (a > 0.5f)
+	}
+
+	static void DecodeBC1Block(const uint32* block, uint32* texels)
+	{
+		uint32 palette[4];
+		BC1Palette(block[0] & 0xffff, block[0] >> 16, palette);
+		uint32 indices = block[1];
+		for (int i = 0; i < 16; i++)
+			texels[i] = palette[(indices >> (i * 2)) & 3];
+	}
+
+	static void EncodeBC1Block(const uint32* texels, uint32* block)
+	{
+		//bounding box endpoints, inset by 1/16 of the range to cut the quantization error
+		uint32 minC[3] = { 255, 255, 255 };
+		uint32 maxC[3] = { 0, 0, 0 };
+		for (int i = 0; i < 16; i++)
 		{
-			c[0] = vmath::lerp(c[0], c[1], a - 0.5f);
-			c[2] = vmath::lerp(c[2], c[3], a - 0.5f);
+			for (int c = 0; c < 3; c++)
+			{
+				uint32 v = (texels[i] >> (c * 8)) & 0xff;
+				minC[c] = std::min<uint32>(minC[c], v);
+				maxC[c] = std::max<uint32>(maxC[c], v);
+			}
 		}
-		else
+		uint32 hi = 0, lo = 0;
+		for (int c = 0; c < 3; c++)
+		{
+			uint32 inset = (maxC[c] - minC[c]) >> 4;
+			hi |= (maxC[c] - inset) << (c * 8);
+			lo |= (minC[c] + inset) << (c * 8);
+		}
+		uint32 c0 = Pack565(hi);
+		uint32 c1 = Pack565(lo);
+		if (c0 < c1)
+			std::swap(c0, c1);
+		block[0] = c0 | (c1 << 16);
+		block[1] = 0;
+		if (c0 == c1)
+			return;
+
+		uint32 palette[4];
+		BC1Palette(c0, c1, palette);
+		uint32 indices = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			uint32 best = 0;
+			int bestDist = 0x7fffffff;
+			for (uint32 p = 0; p < 4; p++)
+			{
+				int dist = 0;
+				for (int c = 0; c < 3; c++)
+				{
+					int d = (int)((texels[i] >> (c * 8)) & 0xff) - (int)((palette[p] >> (c * 8)) & 0xff);
+					dist += d * d;
+				}
+				if (dist < bestDist)
+				{
+					bestDist = dist;
+					best = p;
+				}
+			}
+			indices |= best << (i * 2);
+		}
+		block[1] = indices;
+	}
+
+	void Texture::CompressLevels()
+	{
+		uint32 id = ++s_uploadID;
+		for (size_t i = 0; i < m_levels.size(); i++)
+		{
+			MipLevel& level = m_levels[i];
+			uint32 tileStride = (level.width + 3) / 4;
+			uint32 tileRows = (level.height + 3) / 4;
+			uint32* blocks = AllocateLevel(tileStride * tileRows * 2);
+			uint32 texels[16];
+			for (uint32 by = 0; by < tileRows; by++)
+			{
+				for (uint32 bx = 0; bx < tileStride; bx++)
+				{
+					for (uint32 t = 0; t < 16; t++)
+					{
+						uint32 sx = std::min<uint32>(bx * 4 + (t & 3), level.width - 1);
+						uint32 sy = std::min<uint32>(by * 4 + (t >> 2), level.height - 1);
+						texels[t] = level.data[sx + level.width * sy];
+					}
+					EncodeBC1Block(texels, &blocks[(by * tileStride + bx) * 2]);
+				}
+			}
+			FreeLevel(level.data);
+			level.data = blocks;
+			level.tileStride = tileStride;
+			level.key = (id << 5) | (uint32)i;
+		}
+		m_format = FORMAT_BC1;
+	}
+
+	//small direct mapped cache of decoded blocks, one per sampling thread
+	struct DecodedBlockCache
+	{
+		enum { SIZE = 16 };
+		uint32 key[SIZE];
+		uint32 block[SIZE];
+		uint32 texels[SIZE][16];
+
+		DecodedBlockCache() {
+			memset(key, 0, sizeof(key));
+		}
+	};
+	static thread_local DecodedBlockCache s_blockCache;
+
+	uint32 Texture::TexelBC1(const MipLevel& level, uint32 x, uint32 y) const
+	{
+		uint32 blockIndex = (y >> 2) * level.tileStride + (x >> 2);
+		uint32 slot = (blockIndex ^ (blockIndex >> 4) ^ level.key) & (DecodedBlockCache::SIZE - 1);
+		DecodedBlockCache& cache = s_blockCache;
+		if (cache.key[slot] != level.key || cache.block[slot] != blockIndex)
+		{
+			DecodeBC1Block(&level.data[blockIndex * 2], cache.texels[slot]);
+			cache.key[slot] = level.key;
+			cache.block[slot] = blockIndex;
+		}
+		return cache.texels[slot][((y & 3) << 2) | (x & 3)];
+	}
+
+	Color Texture::Sampler2D(const vmath::vec2* uv) const
+	{
+		switch (filter_mode)
+		{
+		case BILINEAR:
+		case TRILINEAR:
+			return Sampler2D_bilinear(uv, m_levels[0]);
+		case NEAREST:
+		case NEAREST_MIPMAP:
+			return Sampler2D_nearest(uv, m_levels[0]);
+		default:
+			return Sampler2D_bilinear(uv, m_levels[0]);
+		}
+	}
+
+	Color Texture::Sampler2D(const vmath::vec2* uv, const vmath::vec2* duvdx, const vmath::vec2* duvdy) const
+	{
+		return Sampler2D(uv, duvdx, duvdy, filter_mode, 0.0f);
+	}
+
+	Color Texture::Sampler2D(const vmath::vec2* uv, const vmath::vec2* duvdx, const vmath::vec2* duvdy, FILTER_MODE filter, float lodBias) const
+	{
+		if (filter == NEAREST)
+			return Sampler2D_nearest(uv, m_levels[0]);
+		if (filter == BILINEAR)
+			return Sampler2D_bilinear(uv, m_levels[0]);
+
+		float lod = ComputeLOD(duvdx, duvdy);
+		if (lodBias != 0.0f)
+			lod = std::min<float>(std::max<float>(lod + lodBias, 0.0f), (float)(m_levels.size() - 1));
+		if (filter == NEAREST_MIPMAP)
+			return Sampler2D_nearest(uv, m_levels[(uint32)(lod + 0.5f)]);
+
+		uint32 level = (uint32)lod;
+		float t = lod - level;
+		Color c0 = Sampler2D_bilinear(uv, m_levels[level]);
+		if (t <= 0.0f || level + 1 >= m_levels.size())
+			return c0;
+		Color c1 = Sampler2D_bilinear(uv, m_levels[level + 1]);
+		return Color(LerpColor(c0, c1, (uint32)(t * 256.0f)));
+	}
+
+	float Texture::ComputeLOD(const vmath::vec2* duvdx, const vmath::vec2* duvdy) const
+	{
+		//uv derivatives in texel units, lod = log2(max(|dx|, |dy|))
+		float dux = (*duvdx)[0] * m_width;
+		float dvx = (*duvdx)[1] * m_height;
+		float duy = (*duvdy)[0] * m_width;
+		float dvy = (*duvdy)[1] * m_height;
+		float rho2 = std::max<float>(dux * dux + dvx * dvx, duy * duy + dvy * dvy);
+		if (!(rho2 > 1.0f))
+			return 0.0f;
+		float lod = 0.5f * std::log2(rho2);
+		return std::min<float>(lod, (float)(m_levels.size() - 1));
+	}
+
+	Color Texture::Sampler2D_nearest(const vmath::vec2* uv, const MipLevel& level) const
+	{
+		//floor through 24.8 fixed point so negative coordinates wrap and mirror correctly
+		int x = (int)((*uv)[0] * level.width * 256.0f) >> 8;
+		int y = (int)((*uv)[1] * level.height * 256.0f) >> 8;
+		return Color(Texel(level, Address(x, level.width), Address(y, level.height)));
+	}
+
+	Color Texture::Sampler2D_bilinear(const vmath::vec2* uv, const MipLevel& level) const
+	{
+		//24.8 fixed point texel coordinate, centers sit at +0.5 and the arithmetic shift acts as floor
+		int fx = (int)((*uv)[0] * level.width * 256.0f) - 128;
+		int fy = (int)((*uv)[1] * level.height * 256.0f) - 128;
+		uint32 wx = fx & 0xff;
+		uint32 wy = fy & 0xff;
+		int x0 = fx >> 8;
+		int y0 = fy >> 8;
+		uint32 u0 = Address(x0, level.width);
+		uint32 u1 = Address(x0 + 1, level.width);
+		uint32 v0 = Address(y0, level.height);
+		uint32 v1 = Address(y0 + 1, level.height);
+
+		uint32 top = LerpColor(Texel(level, u0, v0), Texel(level, u1, v0), wx);
+		uint32 bottom = LerpColor(Texel(level, u0, v1), Texel(level, u1, v1), wx);
+		return Color(LerpColor(top, bottom, wy));
+	}
+
+	void Texture::Sampler2D_bilinear4(const vmath::vec2* uv, Color* out) const
+	{
+		const MipLevel& level = m_levels[0];
+		__m128 u = _mm_set_ps(uv[3][0], uv[2][0], uv[1][0], uv[0][0]);
+		__m128 v = _mm_set_ps(uv[3][1], uv[2][1], uv[1][1], uv[0][1]);
+		__m128i fx = _mm_sub_epi32(_mm_cvttps_epi32(_mm_mul_ps(u, _mm_set1_ps(level.width * 256.0f))), _mm_set1_epi32(128));
+		__m128i fy = _mm_sub_epi32(_mm_cvttps_epi32(_mm_mul_ps(v, _mm_set1_ps(level.height * 256.0f))), _mm_set1_epi32(128));
+
+		__m128i maxX = _mm_set1_epi32(level.width - 1);
+		__m128i maxY = _mm_set1_epi32(level.height - 1);
+		__m128i one = _mm_set1_epi32(1);
+		__m128i x0 = _mm_srai_epi32(fx, 8);
+		__m128i y0 = _mm_srai_epi32(fy, 8);
+		__m128i x1 = _mm_add_epi32(x0, one);
+		__m128i y1 = _mm_add_epi32(y0, one);
+		bool resolved = true;
+		if (address_mode == ADDRESS_CLAMP)
 		{
-			c[0] = vmath::lerp(c[1], c[0], a + 0.5f);
-			c[2] = vmath::lerp(c[3], c[2], a + 0.5f);
+			//clamp without branches: x = x > max ? max : x, then x = x < 0 ? 0 : x
+#define SOFT3D_CLAMP4(x, m) _mm_andnot_si128(_mm_srai_epi32(x, 31), _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi32(x, m), m), _mm_andnot_si128(_mm_cmpgt_epi32(x, m), x)))
+			x0 = SOFT3D_CLAMP4(x0, maxX);
+			x1 = SOFT3D_CLAMP4(x1, maxX);
+			y0 = SOFT3D_CLAMP4(y0, maxY);
+			y1 = SOFT3D_CLAMP4(y1, maxY);
+#undef SOFT3D_CLAMP4
 		}
-		if (b > 0.5f)
+		else if (address_mode == ADDRESS_WRAP && m_pow2)
 		{
-			c[0] = vmath::lerp(c[0], c[2], b - 0.5f);
+			x0 = _mm_and_si128(x0, maxX);
+			x1 = _mm_and_si128(x1, maxX);
+			y0 = _mm_and_si128(y0, maxY);
+			y1 = _mm_and_si128(y1, maxY);
 		}
 		else
 		{
-			c[0] = vmath::lerp(c[2], c[0], b + 0.5f);
+			resolved = false;
 		}
-		return c[0];
+
+		alignas(16) uint32 ax0[4], ax1[4], ay0[4], ay1[4], awx[4], awy[4];
+		_mm_store_si128((__m128i*)ax0, x0);
+		_mm_store_si128((__m128i*)ax1, x1);
+		_mm_store_si128((__m128i*)ay0, y0);
+		_mm_store_si128((__m128i*)ay1, y1);
+		_mm_store_si128((__m128i*)awx, _mm_and_si128(fx, _mm_set1_epi32(0xff)));
+		_mm_store_si128((__m128i*)awy, _mm_and_si128(fy, _mm_set1_epi32(0xff)));
+
+		//gather, the four taps of pixel i land in lane i of t00..t11
+		alignas(16) uint32 t00[4], t10[4], t01[4], t11[4];
+		if (!resolved)
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				ax0[i] = Address((int)ax0[i], level.width);
+				ax1[i] = Address((int)ax1[i], level.width);
+				ay0[i] = Address((int)ay0[i], level.height);
+				ay1[i] = Address((int)ay1[i], level.height);
+			}
+		}
+		for (int i = 0; i < 4; i++)
+		{
+			t00[i] = Texel(level, ax0[i], ay0[i]);
+			t10[i] = Texel(level, ax1[i], ay0[i]);
+			t01[i] = Texel(level, ax0[i], ay1[i]);
+			t11[i] = Texel(level, ax1[i], ay1[i]);
+		}
+
+		//weights broadcast to the four 16 bit channel lanes of their pixel
+		__m128i wxLo = _mm_set_epi16(awx[1], awx[1], awx[1], awx[1], awx[0], awx[0], awx[0], awx[0]);
+		__m128i wxHi = _mm_set_epi16(awx[3], awx[3], awx[3], awx[3], awx[2], awx[2], awx[2], awx[2]);
+		__m128i wyLo = _mm_set_epi16(awy[1], awy[1], awy[1], awy[1], awy[0], awy[0], awy[0], awy[0]);
+		__m128i wyHi = _mm_set_epi16(awy[3], awy[3], awy[3], awy[3], awy[2], awy[2], awy[2], awy[2]);
+		__m128i w256 = _mm_set1_epi16(256);
+		__m128i zero = _mm_setzero_si128();
+
+		__m128i c00 = _mm_load_si128((const __m128i*)t00);
+		__m128i c10 = _mm_load_si128((const __m128i*)t10);
+		__m128i c01 = _mm_load_si128((const __m128i*)t01);
+		__m128i c11 = _mm_load_si128((const __m128i*)t11);
+
+		//c*(256-w) + c'*w stays below 65536, so unsigned 16 bit lanes never overflow
+#define SOFT3D_LERP16(a, b, w) _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(a, _mm_sub_epi16(w256, w)), _mm_mullo_epi16(b, w)), 8)
+		__m128i topLo = SOFT3D_LERP16(_mm_unpacklo_epi8(c00, zero), _mm_unpacklo_epi8(c10, zero), wxLo);
+		__m128i topHi = SOFT3D_LERP16(_mm_unpackhi_epi8(c00, zero), _mm_unpackhi_epi8(c10, zero), wxHi);
+		__m128i botLo = SOFT3D_LERP16(_mm_unpacklo_epi8(c01, zero), _mm_unpacklo_epi8(c11, zero), wxLo);
+		__m128i botHi = SOFT3D_LERP16(_mm_unpackhi_epi8(c01, zero), _mm_unpackhi_epi8(c11, zero), wxHi);
+		__m128i resLo = SOFT3D_LERP16(topLo, botLo, wyLo);
+		__m128i resHi = SOFT3D_LERP16(topHi, botHi, wyHi);
+#undef SOFT3D_LERP16
+
+		_mm_storeu_si128((__m128i*)out, _mm_packus_epi16(resLo, resHi));
 	}
 }
\ No newline at end of file
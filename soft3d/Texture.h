@@ -1,30 +1,149 @@
 #pragma once
+#include <vector>
 
 namespace soft3d
 {
 
+	class MappedFile;
+
 	class Texture
 	{
 	public:
 		Texture();
 		~Texture();
-		void CopyFromBuffer(const uint32* buf, int width, int height);
+		enum LAYOUT
+		{
+			LAYOUT_LINEAR,
+			LAYOUT_TILED,//4x4 texel tiles, one 64 byte cache line each
+		};
+
+		enum FORMAT
+		{
+			FORMAT_BGRA8,
+			FORMAT_BC1,//4x4 blocks of two 565 endpoints and 2 bit indices, 8x smaller than BGRA8
+		};
+
+		void CopyFromBuffer(const uint32* buf, int width, int height, LAYOUT layout = LAYOUT_LINEAR, FORMAT format = FORMAT_BGRA8);
 		Color Sampler2D(const vmath::vec2* uv) const;
+		Color Sampler2D(const vmath::vec2* uv, const vmath::vec2* duvdx, const vmath::vec2* duvdy) const;
+		//bilinear on level 0 for four pixels at once, out receives four colors
+		void Sampler2D_bilinear4(const vmath::vec2* uv, Color* out) const;
 
 		enum FILTER_MODE
 		{
 			NEAREST,
 			BILINEAR,
+			NEAREST_MIPMAP,//nearest texel of the nearest mip level
+			TRILINEAR,//bilinear on the two nearest mip levels, blended by lod
 		};
 		FILTER_MODE filter_mode = BILINEAR;
 
+		//samples with filter instead of filter_mode, which must not need mipmaps when filter_mode does not;
+		//lodBias is added to the mip level
+		Color Sampler2D(const vmath::vec2* uv, const vmath::vec2* duvdx, const vmath::vec2* duvdy, FILTER_MODE filter, float lodBias) const;
+		//the filter without blending, on the same mip levels
+		static inline FILTER_MODE CheaperFilter(FILTER_MODE filter) {
+			if (filter == BILINEAR)
+				return NEAREST;
+			if (filter == TRILINEAR)
+				return NEAREST_MIPMAP;
+			return filter;
+		}
+
+		enum ADDRESS_MODE
+		{
+			ADDRESS_CLAMP,
+			ADDRESS_WRAP,
+			ADDRESS_MIRROR,
+		};
+		ADDRESS_MODE address_mode = ADDRESS_CLAMP;
+
+		inline bool UseMipmap() const {
+			return filter_mode == NEAREST_MIPMAP || filter_mode == TRILINEAR;
+		}
+		inline uint32 GetLevelCount() const {
+			return m_levels.size();
+		}
+		inline LAYOUT GetLayout() const {
+			return m_layout;
+		}
+		inline bool IsPow2() const {
+			return m_pow2;
+		}
+		inline FORMAT GetFormat() const {
+			return m_format;
+		}
+		size_t GetMemorySize() const;
+
+		//binary dump of every level after mips, swizzle and compression, the stamp identifies the source image
+		bool SaveCache(const char* filename, uint64 stamp) const;
+		//maps a cache written by SaveCache, levels point straight into the mapping, fails on a stamp mismatch
+		bool LoadCache(const char* filename, uint64 stamp);
+
 	private:
+		struct MipLevel
+		{
+			uint32* data;
+			uint16 width;
+			uint16 height;
+			uint16 tileStride;
+			uint32 key;//identifies the level in the decoded block cache
+		};
+
 		uint32* m_data;
 		uint16 m_width;
 		uint16 m_height;
+		std::vector<MipLevel> m_levels;
+		LAYOUT m_layout = LAYOUT_LINEAR;
+		bool m_pow2 = false;//every level of a power of two texture is power of two too
+		FORMAT m_format = FORMAT_BGRA8;
+		std::shared_ptr<MappedFile> m_mapping;//owns the level data when loaded from a cache
+
+		inline uint32 Texel(const MipLevel& level, uint32 x, uint32 y) const
+		{
+			if (m_format == FORMAT_BC1)
+				return TexelBC1(level, x, y);
+			if (m_layout == LAYOUT_TILED)
+				return level.data[(((y >> 2) * level.tileStride + (x >> 2)) << 4) + ((y & 3) << 2) + (x & 3)];
+			return level.data[x + level.width * y];
+		}
+
+		//maps an integer texel coordinate into [0, size) according to address_mode,
+		//power of two sizes wrap and mirror with a mask instead of a modulo
+		inline uint32 Address(int x, uint32 size) const
+		{
+			switch (address_mode)
+			{
+			case ADDRESS_WRAP:
+				if (m_pow2)
+					return x & (size - 1);
+				return ((x % (int)size) + size) % size;
+			case ADDRESS_MIRROR:
+			{
+				uint32 t;
+				if (m_pow2)
+					t = x & (size * 2 - 1);
+				else
+					t = ((x % (int)(size * 2)) + size * 2) % (size * 2);
+				return t < size ? t : size * 2 - 1 - t;
+			}
+			case ADDRESS_CLAMP:
+			default:
+				return (uint32)std::min<int>(std::max<int>(x, 0), size - 1);
+			}
+		}
+
+		uint32 TexelBC1(const MipLevel& level, uint32 x, uint32 y) const;
+
+		void GenerateMipmaps();
+		void SwizzleLevels();
+		void CompressLevels();
+		void ReleaseLevels();
+		size_t LevelSize(const MipLevel& level) const;
+		float ComputeLOD(const vmath::vec2* duvdx, const vmath::vec2* duvdy) const;
 
-		Color Sampler2D_nearest(const vmath::vec2* uv) const;
-		Color Sampler2D_bilinear(const vmath::vec2* uv) const;
+		Color Sampler2D_nearest(const vmath::vec2* uv, const MipLevel& level) const;
+		Color Sampler2D_bilinear(const vmath::vec2* uv, const MipLevel& level) const;
 	};
 
 }
\ No newline at end of file
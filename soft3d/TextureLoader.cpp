@@ -1,95 +1,172 @@
 #include "TextureLoader.h"
-#pragma comment(lib, "windowscodecs.lib")
+#include "MappedFile.h"
+#include <png.h>
+#include <jpeglib.h>
+#include <setjmp.h>
+#include <string>
+#if defined(_MSC_VER) || defined(__SSSE3__)
+#include <tmmintrin.h>
+#define SOFT3D_SSSE3
+#endif
+#ifdef _MSC_VER
+#pragma comment(lib, "libpng16.lib")
+#pragma comment(lib, "jpeg.lib")
+#pragma comment(lib, "zlib.lib")
+#endif
 
 namespace soft3d
 {
 	TextureLoader* TextureLoader::s_instance = nullptr;
 
-	void ThrowIfFailed(HRESULT hr) {
-		if (FAILED(hr))
-		{
-			throw "Error";
-		}
-	}
-
 	TextureLoader::TextureLoader()
 	{
-		HRESULT hr;
-		hr = CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&m_pIWICFactory));
 	}
 
 	TextureLoader::~TextureLoader()
 	{
-		m_pIWICFactory->Release();
 	}
 
-	void TextureLoader::LoadTexture(const wchar_t* filename)
+	bool TextureLoader::Decode(const char* filename, std::vector<uint32>& pixels, uint32& width, uint32& height) const
+	{
+		//pick the decoder from the signature, not the extension
+		unsigned char sig[8] = {};
+		FILE* file = fopen(filename, "rb");
+		if (file == nullptr)
+			return false;
+		size_t len = fread(sig, 1, sizeof(sig), file);
+		fclose(file);
+
+		if (len == sizeof(sig) && png_sig_cmp(sig, 0, sizeof(sig)) == 0)
+			return DecodePNG(filename, pixels, width, height);
+		if (len >= 3 && sig[0] == 0xff && sig[1] == 0xd8 && sig[2] == 0xff)
+			return DecodeJPEG(filename, pixels, width, height);
+		return false;
+	}
+
+	bool TextureLoader::DecodePNG(const char* filename, std::vector<uint32>& pixels, uint32& width, uint32& height) const
 	{
-		HRESULT hr = S_OK;
-
-		IWICBitmapDecoder *pIDecoder = NULL;
-		IWICBitmapFrameDecode *pIDecoderFrame = NULL;
-		UINT nFrameCount = 0;
-
-		// Create decoder for an image.
-		hr = m_pIWICFactory->CreateDecoderFromFilename(
-			filename,                  // Image to be decoded
-			NULL,                           // Do not prefer a particular vendor
-			GENERIC_READ,                   // Desired read access to the file
-			WICDecodeMetadataCacheOnDemand, // Cache metadata when needed
-			&pIDecoder                      // Pointer to the decoder
-			);
-
-			// Retrieve the next bitmap frame.
-		if (SUCCEEDED(hr))
+		//libpng converts palette, gray and 16 bit images straight to the internal BGRA order
+		png_image image;
+		memset(&image, 0, sizeof(image));
+		image.version = PNG_IMAGE_VERSION;
+		if (!png_image_begin_read_from_file(&image, filename))
+			return false;
+
+		image.format = PNG_FORMAT_BGRA;
+		pixels.resize(image.width * image.height);
+		if (!png_image_finish_read(&image, nullptr, &pixels[0], 0, nullptr))
 		{
-			hr = pIDecoder->GetFrame(0, &pIDecoderFrame);
+			png_image_free(&image);
+			return false;
 		}
+		width = image.width;
+		height = image.height;
+		return true;
+	}
 
-		// Retrieve the size of the bitmap frame.
-		if (SUCCEEDED(hr))
+	//RGB scanline to BGRA with opaque alpha, 4 pixels per shuffle
+	static void ConvertRGBToBGRA(const unsigned char* src, uint32* dst, uint32 count)
+	{
+		uint32 i = 0;
+#ifdef SOFT3D_SSSE3
+		const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+		const __m128i alpha = _mm_set1_epi32(0xff000000);
+		//every load reads 16 bytes but consumes 12, stop while the last 4 are still inside the row
+		for (; i + 6 <= count; i += 4)
 		{
-			hr = pIDecoderFrame->GetSize(&m_width, &m_height);
+			__m128i rgb = _mm_loadu_si128((const __m128i*)(src + i * 3));
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alpha));
 		}
+#endif
+		for (; i < count; i++)
+		{
+			const unsigned char* p = src + i * 3;
+			dst[i] = 0xff000000 | (p[0] << 16) | (p[1] << 8) | p[2];
+		}
+	}
 
-		IWICBitmap *pIBitmap = NULL;
-		IWICBitmapLock *pILock = NULL;
+	struct JPEGErrorManager
+	{
+		jpeg_error_mgr pub;
+		jmp_buf jump;
+	};
+
+	static void JPEGErrorExit(j_common_ptr cinfo)
+	{
+		longjmp(((JPEGErrorManager*)cinfo->err)->jump, 1);
+	}
+
+	bool TextureLoader::DecodeJPEG(const char* filename, std::vector<uint32>& pixels, uint32& width, uint32& height) const
+	{
+		FILE* file = fopen(filename, "rb");
+		if (file == nullptr)
+			return false;
+
+		jpeg_decompress_struct cinfo;
+		JPEGErrorManager jerr;
+		cinfo.err = jpeg_std_error(&jerr.pub);
+		jerr.pub.error_exit = JPEGErrorExit;
+		//errors longjmp back here; locals changed between a setjmp and the longjmp are indeterminate
+		//after it, so the header is read under one setjmp, the buffers are sized while no libjpeg call can jump,
+		//and the scanline loop under a second one only writes their contents
+		std::vector<unsigned char> scanline;
+		if (setjmp(jerr.jump))
+		{
+			jpeg_destroy_decompress(&cinfo);
+			fclose(file);
+			return false;
+		}
+		jpeg_create_decompress(&cinfo);
+		jpeg_stdio_src(&cinfo, file);
+		jpeg_read_header(&cinfo, TRUE);
+		cinfo.out_color_space = JCS_RGB;
+		jpeg_start_decompress(&cinfo);
 
-		// Create the bitmap from the image frame.
-		if (SUCCEEDED(hr))
+		width = cinfo.output_width;
+		height = cinfo.output_height;
+		pixels.resize(width * height);
+		scanline.resize(width * 3);
+		if (setjmp(jerr.jump))
 		{
-			hr = m_pIWICFactory->CreateBitmapFromSource(
-				pIDecoderFrame,          // Create a bitmap from the image frame
-				WICBitmapCacheOnDemand,  // Cache metadata when needed
-				&pIBitmap);              // Pointer to the bitmap
+			jpeg_destroy_decompress(&cinfo);
+			fclose(file);
+			return false;
 		}
-		
-		if (SUCCEEDED(hr))
+		while (cinfo.output_scanline < cinfo.output_height)
 		{
-			hr = pIBitmap->Lock(0, WICBitmapLockWrite, &pILock);
-			
-			if (SUCCEEDED(hr))
-			{
-				UINT cbBufferSize = 0;
-				BYTE *pv = NULL;
-
-				if (SUCCEEDED(hr))
-				{
-					hr = pILock->GetDataPointer(&cbBufferSize, &pv);
-				}
-				m_buffer = new uint32[m_width * m_height];
-				for (unsigned long long i = 0; i < cbBufferSize / 3; i++)
-				{
-					unsigned long long j = i * 3;
-					m_buffer[i] = (pv[j]) + (pv[j + 1] << 8) + (pv[j + 2] << 16);
-				}
-
-				pILock->Release();
-			}
+			uint32 y = cinfo.output_scanline;
+			JSAMPROW row = &scanline[0];
+			jpeg_read_scanlines(&cinfo, &row, 1);
+			ConvertRGBToBGRA(&scanline[0], &pixels[y * width], width);
 		}
 
-		pIDecoderFrame->Release();
-		pIDecoder->Release();
+		jpeg_finish_decompress(&cinfo);
+		jpeg_destroy_decompress(&cinfo);
+		fclose(file);
+		return true;
+	}
+
+	std::shared_ptr<Texture> TextureLoader::LoadTexture(const char* filename, Texture::LAYOUT layout, Texture::FORMAT format)
+	{
+		//a cache is valid for one version of the source file, size and mtime stand in for a content hash
+		uint64 stamp = MappedFile::GetFileStamp(filename);
+		if (stamp == 0)
+			return nullptr;
+		std::string cacheName = std::string(filename) + ".s3dtex";
+
+		std::shared_ptr<Texture> tex(new Texture());
+		if (useCache && tex->LoadCache(cacheName.c_str(), stamp) && tex->GetFormat() == format
+			&& (format == Texture::FORMAT_BC1 || tex->GetLayout() == layout))
+			return tex;
+
+		std::vector<uint32> pixels;
+		uint32 width, height;
+		if (!Decode(filename, pixels, width, height))
+			return nullptr;
+		tex->CopyFromBuffer(&pixels[0], width, height, layout, format);
+		if (useCache)
+			tex->SaveCache(cacheName.c_str(), stamp);
+		return tex;
 	}
 
-}
\ No newline at end of file
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "soft3d.h"
-#include <wincodec.h>
+#include "Texture.h"
+#include <vector>
 
 namespace soft3d
 {
@@ -14,28 +15,24 @@ namespace soft3d
 			return *s_instance;
 		}
 		~TextureLoader();
-		void LoadTexture(const wchar_t* filename);
 
-		const uint32* GetData() const {
-			return m_buffer;
-		}
-		uint32 GetWidth() const {
-			return m_width;
-		}
-		uint32 GetHeight() const {
-			return m_height;
-		}
+		//decodes a png or jpeg file into BGRA pixels
+		bool Decode(const char* filename, std::vector<uint32>& pixels, uint32& width, uint32& height) const;
+
+		//maps <filename>.s3dtex when it is up to date, otherwise decodes, builds the texture and writes the cache,
+		//returns nullptr when the image can not be decoded
+		std::shared_ptr<Texture> LoadTexture(const char* filename, Texture::LAYOUT layout = Texture::LAYOUT_LINEAR, Texture::FORMAT format = Texture::FORMAT_BGRA8);
+
+		bool useCache = true;
 
 	protected:
 		TextureLoader();
 
 	private:
-		IWICImagingFactory* m_pIWICFactory;
-		uint32* m_buffer;
-		uint32 m_width;
-		uint32 m_height;
+		bool DecodePNG(const char* filename, std::vector<uint32>& pixels, uint32& width, uint32& height) const;
+		bool DecodeJPEG(const char* filename, std::vector<uint32>& pixels, uint32& width, uint32& height) const;
 
 		static TextureLoader* s_instance;
 	};
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,116 @@
+#include "soft3d.h"
+#include "ThreadPool.h"
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+
+namespace soft3d
+{
+
+	ThreadPool& ThreadPool::Instance()
+	{
+		static ThreadPool s_instance;
+		return s_instance;
+	}
+
+	ThreadPool::ThreadPool(uint32 threadCount) :
+		m_stop(false)
+	{
+		if (threadCount == 0)
+			threadCount = std::max(boost::thread::hardware_concurrency(), 1u);
+		for (uint32 i = 0; i < threadCount; i++)
+			m_threads.push_back(new boost::thread(boost::bind(&ThreadPool::ThreadFun, this)));
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			m_stop = true;
+		}
+		m_cond.notify_all();
+		for (size_t i = 0; i < m_threads.size(); i++)
+		{
+			m_threads[i]->join();
+			delete m_threads[i];
+		}
+	}
+
+	void ThreadPool::Post(const boost::function<void()>& task)
+	{
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			m_tasks.push_back(task);
+		}
+		m_cond.notify_one();
+	}
+
+	void ThreadPool::ThreadFun()
+	{
+		while (true)
+		{
+			boost::function<void()> task;
+			{
+				boost::mutex::scoped_lock lock(m_mutex);
+				while (m_tasks.empty() && !m_stop)
+					m_cond.wait(lock);
+				//queued tasks still run on shutdown, nobody waits on a dropped one
+				if (m_tasks.empty())
+					return;
+				task = m_tasks.front();
+				m_tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	//shared by the caller and the helpers it posted, helpers that start late find no work left
+	struct ParallelForState
+	{
+		boost::function<void(uint32)> func;
+		uint32 count;
+		uint32 next;
+		uint32 done;
+		boost::mutex mutex;
+		boost::condition_variable cond;
+
+		void Run()
+		{
+			while (true)
+			{
+				uint32 i;
+				{
+					boost::mutex::scoped_lock lock(mutex);
+					if (next >= count)
+						return;
+					i = next++;
+				}
+				func(i);
+				boost::mutex::scoped_lock lock(mutex);
+				if (++done == count)
+					cond.notify_all();
+			}
+		}
+	};
+
+	void ThreadPool::ParallelFor(uint32 count, const boost::function<void(uint32)>& func)
+	{
+		if (count == 0)
+			return;
+		boost::shared_ptr<ParallelForState> state = boost::make_shared<ParallelForState>();
+		state->func = func;
+		state->count = count;
+		state->next = 0;
+		state->done = 0;
+
+		uint32 helpers = std::min<uint32>(count - 1, m_threads.size());
+		for (uint32 i = 0; i < helpers; i++)
+			Post(boost::bind(&ParallelForState::Run, state));
+		state->Run();
+
+		//only items already picked up by running helpers are left, so this wait always ends
+		boost::mutex::scoped_lock lock(state->mutex);
+		while (state->done < count)
+			state->cond.wait(lock);
+	}
+
+}
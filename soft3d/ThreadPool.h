@@ -0,0 +1,43 @@
+#pragma once
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include <deque>
+#include <vector>
+
+namespace soft3d
+{
+
+	//fixed set of worker threads draining a FIFO of tasks, meant for loading and other
+	//coarse work off the render threads
+	class ThreadPool : public boost::noncopyable
+	{
+	public:
+		//shared pool sized to the machine
+		static ThreadPool& Instance();
+
+		//0 picks one thread per hardware thread
+		explicit ThreadPool(uint32 threadCount = 0);
+		~ThreadPool();
+
+		void Post(const boost::function<void()>& task);
+
+		//runs func(0) .. func(count - 1) on the pool and the calling thread, returns when all are done;
+		//the caller keeps working instead of sleeping, so nesting inside a pool task can not deadlock
+		void ParallelFor(uint32 count, const boost::function<void(uint32)>& func);
+
+		uint32 GetThreadCount() const {
+			return m_threads.size();
+		}
+
+	private:
+		void ThreadFun();
+
+		std::vector<boost::thread*> m_threads;
+		std::deque<boost::function<void()> > m_tasks;
+		boost::mutex m_mutex;
+		boost::condition_variable m_cond;
+		bool m_stop;
+	};
+
+}
@@ -0,0 +1,121 @@
+#include "soft3d.h"
+#include "TileClear.h"
+#include "TiledSurface.h"
+#include <boost/thread.hpp>
+
+namespace soft3d
+{
+
+	TileClear::TileClear(bool tiled) :
+		m_pending(0),
+		m_width(0),
+		m_height(0),
+		m_columns(0),
+		m_rows(0),
+		m_color(nullptr),
+		m_depth(nullptr),
+		m_clearColor(0),
+		m_tiled(tiled)
+	{
+	}
+
+	void TileClear::Resize(uint16 width, uint16 height)
+	{
+		if (width == m_width && height == m_height)
+			return;
+		m_width = width;
+		m_height = height;
+		m_columns = (width + TileGrid::TILE_SIZE - 1) >> TileGrid::TILE_SHIFT;
+		m_rows = (height + TileGrid::TILE_SIZE - 1) >> TileGrid::TILE_SHIFT;
+		m_state.reset(new std::atomic<uint32>[m_columns * m_rows]);
+		for (uint32 i = 0; i < (uint32)m_columns * m_rows; i++)
+			m_state[i].store(TILE_READY, std::memory_order_relaxed);
+		m_pending.store(0, std::memory_order_release);
+	}
+
+	void TileClear::Clear(uint32* color, float* depth, uint32 clearColor)
+	{
+		Resolve();
+		m_color = color;
+		m_depth = depth;
+		m_clearColor = clearColor;
+		for (uint32 i = 0; i < (uint32)m_columns * m_rows; i++)
+			Flag(i);
+	}
+
+	void TileClear::Clear(uint32* color, float* depth, const TileGrid& tiles, uint32 clearColor)
+	{
+		//a tile still flagged from a clear into other buffers belongs to them, fill it first
+		Resolve();
+		m_color = color;
+		m_depth = depth;
+		m_clearColor = clearColor;
+		for (uint32 ty = 0; ty < m_rows; ty++)
+		{
+			for (uint32 tx = 0; tx < m_columns; tx++)
+			{
+				if (tiles.Test(tx, ty))
+					Flag(ty * m_columns + tx);
+			}
+		}
+	}
+
+	void TileClear::Flag(uint32 tile)
+	{
+		if (m_state[tile].exchange(TILE_PENDING, std::memory_order_relaxed) == TILE_READY)
+			m_pending.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void TileClear::Materialize(uint32 tile, bool depth)
+	{
+		uint32 expected = TILE_PENDING;
+		if (m_state[tile].compare_exchange_strong(expected, TILE_FILLING, std::memory_order_acquire))
+		{
+			Fill(tile, depth);
+			m_state[tile].store(TILE_READY, std::memory_order_release);
+			m_pending.fetch_sub(1, std::memory_order_release);
+			return;
+		}
+		//another thread got there first, its fill has to land before any of our pixels
+		while (m_state[tile].load(std::memory_order_acquire) != TILE_READY)
+			boost::this_thread::yield();
+	}
+
+	void TileClear::Fill(uint32 tile, bool depth)
+	{
+		if (m_tiled)
+		{
+			std::fill_n(m_color + tile * TiledSurface::TILE_PIXELS, (uint32)TiledSurface::TILE_PIXELS, m_clearColor);
+			if (depth)
+				std::fill_n(m_depth + tile * TiledSurface::TILE_PIXELS, (uint32)TiledSurface::TILE_PIXELS, 0.0f);
+			return;
+		}
+		//linear rows are stored top down
+		uint32 tx = tile % m_columns;
+		uint32 ty = tile / m_columns;
+		uint32 x0 = tx << TileGrid::TILE_SHIFT;
+		uint32 x1 = std::min<uint32>(x0 + TileGrid::TILE_SIZE, m_width);
+		uint32 y0 = ty << TileGrid::TILE_SHIFT;
+		uint32 y1 = std::min<uint32>(y0 + TileGrid::TILE_SIZE, m_height);
+		for (uint32 y = y0; y < y1; y++)
+		{
+			uint32 index = (m_height - 1 - y) * m_width + x0;
+			std::fill_n(m_color + index, x1 - x0, m_clearColor);
+			if (depth)
+				std::fill_n(m_depth + index, x1 - x0, 0.0f);
+		}
+	}
+
+	void TileClear::Resolve()
+	{
+		if (m_pending.load(std::memory_order_acquire) == 0)
+			return;
+		//nothing was drawn into these tiles, their depth is not needed until the next clear
+		for (uint32 i = 0; i < (uint32)m_columns * m_rows; i++)
+		{
+			if (m_state[i].load(std::memory_order_acquire) != TILE_READY)
+				Materialize(i, false);
+		}
+	}
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <boost/noncopyable.hpp>
+#include <atomic>
+#include <memory>
+#include "TileGrid.h"
+
+namespace soft3d
+{
+
+	//deferred clear of a color and depth buffer pair: Clear only flags tiles, a flagged tile is filled
+	//the first time a rasterizer touches it and Resolve fills the color of those nobody touched,
+	//so every pixel is written once at most and any 32 bit clear color works
+	class TileClear : public boost::noncopyable
+	{
+	public:
+		//tiled buffers use the TiledSurface layout, a tile is then filled as one contiguous run
+		explicit TileClear(bool tiled = false);
+
+		void Resize(uint16 width, uint16 height);
+
+		//flags the tiles of the buffers; nothing may rasterize meanwhile
+		void Clear(uint32* color, float* depth, uint32 clearColor);
+		void Clear(uint32* color, float* depth, const TileGrid& tiles, uint32 clearColor);
+
+		//clears the flagged tiles of an inclusive pixel rect before they are drawn into, safe from any thread
+		inline void Touch(int minx, int miny, int maxx, int maxy)
+		{
+			if (m_pending.load(std::memory_order_acquire) == 0)
+				return;
+			if (maxx < 0 || maxy < 0 || minx >= m_width || miny >= m_height)
+				return;
+			int tx0 = std::max(minx, 0) >> TileGrid::TILE_SHIFT;
+			int ty0 = std::max(miny, 0) >> TileGrid::TILE_SHIFT;
+			int tx1 = std::min(maxx, m_width - 1) >> TileGrid::TILE_SHIFT;
+			int ty1 = std::min(maxy, m_height - 1) >> TileGrid::TILE_SHIFT;
+			for (int ty = ty0; ty <= ty1; ty++)
+			{
+				for (int tx = tx0; tx <= tx1; tx++)
+				{
+					uint32 tile = ty * m_columns + tx;
+					if (m_state[tile].load(std::memory_order_acquire) != TILE_READY)
+						Materialize(tile, true);
+				}
+			}
+		}
+
+		//fills the color of every tile still flagged, call once the frame is rasterized
+		void Resolve();
+
+	private:
+		enum
+		{
+			TILE_READY,
+			TILE_PENDING,
+			TILE_FILLING,
+		};
+
+		void Flag(uint32 tile);
+		void Materialize(uint32 tile, bool depth);
+		void Fill(uint32 tile, bool depth);
+
+		std::unique_ptr<std::atomic<uint32>[]> m_state;
+		std::atomic<uint32> m_pending;//flagged tiles left, lets Touch return at once after a full redraw
+		uint16 m_width;
+		uint16 m_height;
+		uint16 m_columns;
+		uint16 m_rows;
+		uint32* m_color;
+		float* m_depth;
+		uint32 m_clearColor;
+		bool m_tiled;
+	};
+
+}
@@ -0,0 +1,103 @@
+#include "soft3d.h"
+#include "TileGrid.h"
+
+namespace soft3d
+{
+
+	TileGrid::TileGrid() :
+		m_columns(0),
+		m_rows(0),
+		m_width(0),
+		m_height(0)
+	{
+	}
+
+	void TileGrid::Resize(uint16 width, uint16 height)
+	{
+		if (width == m_width && height == m_height)
+			return;
+		m_width = width;
+		m_height = height;
+		m_columns = (width + TILE_SIZE - 1) >> TILE_SHIFT;
+		m_rows = (height + TILE_SIZE - 1) >> TILE_SHIFT;
+		m_tiles.assign(m_columns * m_rows, 0);
+	}
+
+	void TileGrid::Clear()
+	{
+		std::fill(m_tiles.begin(), m_tiles.end(), 0);
+	}
+
+	void TileGrid::SetAll()
+	{
+		std::fill(m_tiles.begin(), m_tiles.end(), 1);
+	}
+
+	bool TileGrid::ClipRect(int& minx, int& miny, int& maxx, int& maxy) const
+	{
+		if (maxx < 0 || maxy < 0 || minx >= m_width || miny >= m_height || minx > maxx || miny > maxy)
+			return false;
+		minx = std::max(minx, 0);
+		miny = std::max(miny, 0);
+		maxx = std::min(maxx, m_width - 1);
+		maxy = std::min(maxy, m_height - 1);
+		return true;
+	}
+
+	void TileGrid::MarkRect(int minx, int miny, int maxx, int maxy)
+	{
+		if (!ClipRect(minx, miny, maxx, maxy))
+			return;
+		for (int ty = miny >> TILE_SHIFT; ty <= maxy >> TILE_SHIFT; ty++)
+		{
+			for (int tx = minx >> TILE_SHIFT; tx <= maxx >> TILE_SHIFT; tx++)
+				m_tiles[ty * m_columns + tx] = 1;
+		}
+	}
+
+	bool TileGrid::TestRect(int minx, int miny, int maxx, int maxy) const
+	{
+		if (!ClipRect(minx, miny, maxx, maxy))
+			return false;
+		for (int ty = miny >> TILE_SHIFT; ty <= maxy >> TILE_SHIFT; ty++)
+		{
+			for (int tx = minx >> TILE_SHIFT; tx <= maxx >> TILE_SHIFT; tx++)
+			{
+				if (m_tiles[ty * m_columns + tx] != 0)
+					return true;
+			}
+		}
+		return false;
+	}
+
+	void TileGrid::Merge(const TileGrid& other)
+	{
+		if (other.m_tiles.size() != m_tiles.size())
+			return;
+		for (size_t i = 0; i < m_tiles.size(); i++)
+			m_tiles[i] |= other.m_tiles[i];
+	}
+
+	bool TileGrid::Intersects(const TileGrid& other) const
+	{
+		if (other.m_tiles.size() != m_tiles.size())
+			return false;
+		for (size_t i = 0; i < m_tiles.size(); i++)
+		{
+			if (m_tiles[i] & other.m_tiles[i])
+				return true;
+		}
+		return false;
+	}
+
+	bool TileGrid::Any() const
+	{
+		for (size_t i = 0; i < m_tiles.size(); i++)
+		{
+			if (m_tiles[i] != 0)
+				return true;
+		}
+		return false;
+	}
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <vector>
+
+namespace soft3d
+{
+
+	//the screen split into TILE_SIZE square tiles with one flag each, in rasterizer coordinates (y up)
+	class TileGrid
+	{
+	public:
+		enum
+		{
+			TILE_SHIFT = 5,
+			TILE_SIZE = 1 << TILE_SHIFT,
+		};
+
+		TileGrid();
+
+		//keeps the flags when the size does not change
+		void Resize(uint16 width, uint16 height);
+		void Clear();
+		void SetAll();
+
+		//inclusive pixel rect, clipped to the screen
+		void MarkRect(int minx, int miny, int maxx, int maxy);
+		bool TestRect(int minx, int miny, int maxx, int maxy) const;
+
+		void Merge(const TileGrid& other);
+		bool Intersects(const TileGrid& other) const;
+		bool Any() const;
+
+		inline bool Test(uint32 tx, uint32 ty) const {
+			return m_tiles[ty * m_columns + tx] != 0;
+		}
+		inline uint16 GetColumns() const { return m_columns; }
+		inline uint16 GetRows() const { return m_rows; }
+		inline uint16 GetWidth() const { return m_width; }
+		inline uint16 GetHeight() const { return m_height; }
+
+	private:
+		//false when the rect is completely off screen
+		bool ClipRect(int& minx, int& miny, int& maxx, int& maxy) const;
+
+		std::vector<unsigned char> m_tiles;
+		uint16 m_columns;
+		uint16 m_rows;
+		uint16 m_width;
+		uint16 m_height;
+	};
+
+}
@@ -0,0 +1,63 @@
+#include "soft3d.h"
+#include "TiledSurface.h"
+#include <emmintrin.h>
+
+namespace soft3d
+{
+
+	void* TiledSurface::Allocate(uint16 width, uint16 height)
+	{
+		size_t size = GetPixelCount(width, height) * sizeof(uint32);
+		//large pages need SeLockMemoryPrivilege, without it the allocation fails and normal pages are used
+		size_t largePage = GetLargePageMinimum();
+		if (largePage != 0)
+		{
+			size_t largeSize = (size + largePage - 1) / largePage * largePage;
+			void* buffer = VirtualAlloc(NULL, largeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (buffer != NULL)
+				return buffer;
+		}
+		return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	}
+
+	void TiledSurface::Free(void* buffer)
+	{
+		if (buffer != nullptr)
+			VirtualFree(buffer, 0, MEM_RELEASE);
+	}
+
+	void TiledSurface::Detile(const uint32* tiled, uint32* linear, uint16 width, uint16 height)
+	{
+		uint32 tileColumns = GetTileColumns(width);
+		for (uint32 by = 0; by < height; by += BLOCK_SIZE)
+		{
+			uint32 rows = std::min<uint32>(BLOCK_SIZE, height - by);
+			for (uint32 bx = 0; bx < width; bx += BLOCK_SIZE)
+			{
+				const uint32* block = tiled + Offset(bx, by, tileColumns);
+				if (bx + BLOCK_SIZE <= width)
+				{
+					//a block row is 32 aligned bytes, two loads and two stores
+					for (uint32 r = 0; r < rows; r++)
+					{
+						const __m128i* src = (const __m128i*)(block + (r << BLOCK_SHIFT));
+						__m128i* dst = (__m128i*)(linear + (height - 1 - by - r) * width + bx);
+						__m128i a = _mm_load_si128(src);
+						__m128i b = _mm_load_si128(src + 1);
+						_mm_storeu_si128(dst, a);
+						_mm_storeu_si128(dst + 1, b);
+					}
+				}
+				else
+				{
+					for (uint32 r = 0; r < rows; r++)
+					{
+						for (uint32 c = 0; bx + c < width; c++)
+							linear[(height - 1 - by - r) * width + bx + c] = block[(r << BLOCK_SHIFT) + c];
+					}
+				}
+			}
+		}
+	}
+
+}
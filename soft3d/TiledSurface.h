@@ -0,0 +1,44 @@
+#pragma once
+
+namespace soft3d
+{
+
+	//layout of the rasterizer's color and depth buffers: 8x8 pixel blocks, 256 bytes and four cache lines of
+	//color each, grouped 4x4 into the 32x32 tiles of TileGrid so every tile is one contiguous 4KB page;
+	//y is up like the rasterizer coordinates and the size is padded to whole tiles
+	class TiledSurface
+	{
+	public:
+		enum
+		{
+			BLOCK_SHIFT = 3,
+			BLOCK_SIZE = 1 << BLOCK_SHIFT,
+			TILE_SHIFT = 5,//matches TileGrid
+			TILE_SIZE = 1 << TILE_SHIFT,
+			TILE_PIXELS = TILE_SIZE * TILE_SIZE,
+		};
+
+		static inline uint32 GetTileColumns(uint16 width) {
+			return (width + TILE_SIZE - 1) >> TILE_SHIFT;
+		}
+		static inline uint32 GetPixelCount(uint16 width, uint16 height) {
+			return GetTileColumns(width) * GetTileColumns(height) * TILE_PIXELS;
+		}
+
+		//index of pixel (x, y) in a buffer whose rows of tiles are tileColumns wide
+		static inline uint32 Offset(uint32 x, uint32 y, uint32 tileColumns)
+		{
+			uint32 tile = (y >> TILE_SHIFT) * tileColumns + (x >> TILE_SHIFT);
+			uint32 block = (((y >> BLOCK_SHIFT) & 3) << 2) | ((x >> BLOCK_SHIFT) & 3);
+			return (tile << (TILE_SHIFT * 2)) | (block << (BLOCK_SHIFT * 2)) | ((y & (BLOCK_SIZE - 1)) << BLOCK_SHIFT) | (x & (BLOCK_SIZE - 1));
+		}
+
+		//page aligned storage for GetPixelCount pixels of 4 bytes, on large pages when the process may lock them
+		static void* Allocate(uint16 width, uint16 height);
+		static void Free(void* buffer);
+
+		//rewrites a tiled buffer as width * height pixels in rows stored top down, as the window expects them
+		static void Detile(const uint32* tiled, uint32* linear, uint16 width, uint16 height);
+	};
+
+}
@@ -0,0 +1,86 @@
+#include "soft3d.h"
+#include "Upscaler.h"
+#include <emmintrin.h>
+
+namespace soft3d
+{
+
+	Upscaler::Upscaler() :
+		m_srcWidth(0),
+		m_srcHeight(0),
+		m_dstWidth(0),
+		m_dstHeight(0)
+	{
+	}
+
+	void Upscaler::BuildTaps(uint16 srcSize, uint16 dstSize, std::vector<Tap>& taps)
+	{
+		taps.resize(dstSize);
+		for (uint32 d = 0; d < dstSize; d++)
+		{
+			//source position of the center of d, in 1/128 pixels: (d + 0.5) * src / dst - 0.5
+			int pos = (int)(((uint64)(2 * d + 1) * srcSize * 64) / dstSize) - 64;
+			pos = std::max(pos, 0);
+			Tap& tap = taps[d];
+			tap.index = pos >> 7;
+			tap.weight = pos & 127;
+			//the last source pixel is read as the second one of its left neighbour
+			if (tap.index >= srcSize - 1u)
+			{
+				tap.index = srcSize - 2;
+				tap.weight = 128;
+			}
+		}
+	}
+
+	void Upscaler::Resize(uint16 srcWidth, uint16 srcHeight, uint16 dstWidth, uint16 dstHeight)
+	{
+		if (srcWidth == m_srcWidth && srcHeight == m_srcHeight && dstWidth == m_dstWidth && dstHeight == m_dstHeight)
+			return;
+		m_srcWidth = srcWidth;
+		m_srcHeight = srcHeight;
+		m_dstWidth = dstWidth;
+		m_dstHeight = dstHeight;
+		BuildTaps(srcWidth, dstWidth, m_columns);
+		BuildTaps(srcHeight, dstHeight, m_rows);
+	}
+
+	void Upscaler::Run(const uint32* src, uint32* dst) const
+	{
+		const __m128i zero = _mm_setzero_si128();
+		for (uint32 y = 0; y < m_dstHeight; y++)
+		{
+			const uint32* row0 = src + m_rows[y].index * m_srcWidth;
+			const uint32* row1 = row0 + m_srcWidth;
+			const __m128i wy = _mm_set1_epi16(m_rows[y].weight);
+			uint32* out = dst + y * m_dstWidth;
+			for (uint32 x = 0; x < m_dstWidth; x += 2)
+			{
+				//the last pixel of an odd row is computed twice and stored once
+				const Tap& t0 = m_columns[x];
+				const Tap& t1 = m_columns[std::min<uint32>(x + 1, m_dstWidth - 1)];
+				//the 2x2 source pixels of both outputs, a pair of neighbours per load
+				__m128i top = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)(row0 + t0.index)), _mm_loadl_epi64((const __m128i*)(row0 + t1.index)));
+				__m128i bottom = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)(row1 + t0.index)), _mm_loadl_epi64((const __m128i*)(row1 + t1.index)));
+
+				//vertical first, channels widened to 16 bits: a + (b - a) * w / 128 stays within int16
+				__m128i top0 = _mm_unpacklo_epi8(top, zero);
+				__m128i top1 = _mm_unpackhi_epi8(top, zero);
+				__m128i v0 = _mm_add_epi16(top0, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(bottom, zero), top0), wy), 7));
+				__m128i v1 = _mm_add_epi16(top1, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(bottom, zero), top1), wy), 7));
+
+				//then horizontal between the left and right pixel of each output
+				__m128i left = _mm_unpacklo_epi64(v0, v1);
+				__m128i right = _mm_unpackhi_epi64(v0, v1);
+				__m128i wx = _mm_unpacklo_epi64(_mm_set1_epi16(t0.weight), _mm_set1_epi16(t1.weight));
+				__m128i result = _mm_add_epi16(left, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(right, left), wx), 7));
+				result = _mm_packus_epi16(result, result);
+				if (x + 1 < m_dstWidth)
+					_mm_storel_epi64((__m128i*)(out + x), result);
+				else
+					out[x] = _mm_cvtsi128_si32(result);
+			}
+		}
+	}
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+
+namespace soft3d
+{
+
+	//bilinear scale of a 32 bit image, two pixels at a time with SSE2 and 7 bit weights;
+	//pixel centers are aligned so scaling by 1 is an exact copy
+	class Upscaler
+	{
+	public:
+		Upscaler();
+
+		//computes the filter taps, nothing to do when the sizes did not change; both source sides must be 2 or more
+		void Resize(uint16 srcWidth, uint16 srcHeight, uint16 dstWidth, uint16 dstHeight);
+		//src is srcWidth * srcHeight and dst dstWidth * dstHeight pixels, rows in the same order
+		void Run(const uint32* src, uint32* dst) const;
+
+	private:
+		struct Tap
+		{
+			uint32 index;//first of the two source pixels
+			uint16 weight;//of the second one, 0 to 128
+		};
+
+		static void BuildTaps(uint16 srcSize, uint16 dstSize, std::vector<Tap>& taps);
+
+		uint16 m_srcWidth;
+		uint16 m_srcHeight;
+		uint16 m_dstWidth;
+		uint16 m_dstHeight;
+		std::vector<Tap> m_columns;
+		std::vector<Tap> m_rows;
+	};
+
+}
@@ -1,6 +1,7 @@
 #include "soft3d.h"
 #include "vmath.h"
 #include "VertexBufferObject.h"
+#include "MeshCache.h"
 
 using namespace vmath;
 
@@ -13,40 +14,63 @@ namespace soft3d
 		m_size = 0;
 
 		m_colorBuffer = nullptr;
+		m_colorSize = 0;
 
 		m_indexBuffer = nullptr;
 		m_indexSize = 0;
 
 		m_uvBuffer = nullptr;
+		m_uvSize = 0;
 
 		m_normalBuffer = nullptr;
+		m_normalSize = 0;
+
+		m_version = 0;
 
 		m_mode = RENDER_TRIANGLE;
 		m_cullMode = CULL_CCW;
+		m_attributeLayout = ATTRIBUTES_PER_INDEX;
 	}
 
 
 	VertexBufferObject::~VertexBufferObject()
 	{
-		if (m_vertexBuffer != nullptr)
-			delete[] m_vertexBuffer;
-		if (m_colorBuffer != nullptr)
-			delete[] m_colorBuffer;
-		if (m_indexBuffer != nullptr)
-			delete[] m_indexBuffer;
-		if (m_uvBuffer != nullptr)
-			delete[] m_uvBuffer;
-		if (m_normalBuffer != nullptr)
-			delete[] m_normalBuffer;
+	}
+
+	template <typename T>
+	static std::shared_ptr<std::vector<T>> CopyToVector(const void* buffer, uint32 count)
+	{
+		std::shared_ptr<std::vector<T>> copy(new std::vector<T>(count));
+		if (count > 0)
+			memcpy(copy->data(), buffer, count * sizeof(T));
+		return copy;
+	}
+
+	template <typename T>
+	static std::shared_ptr<std::vector<T>> MoveToOwner(std::vector<T>&& buffer)
+	{
+		//moving the vector keeps its heap block, so views taken from it stay valid
+		return std::shared_ptr<std::vector<T>>(new std::vector<T>(std::move(buffer)));
 	}
 
 	void VertexBufferObject::CopyVertexBuffer(const void* buffer, uint32 size)
 	{
-		if (m_vertexBuffer != nullptr)
-			delete[] m_vertexBuffer;
+		std::shared_ptr<std::vector<float>> copy = CopyToVector<float>(buffer, size / 4 * 4);
+		ViewVertexBuffer(copy->data(), size, copy);
+	}
+
+	void VertexBufferObject::ViewVertexBuffer(const void* buffer, uint32 size, const std::shared_ptr<const void>& owner)
+	{
 		m_size = size / 4;
-		m_vertexBuffer = new vec4[m_size];
-		memcpy(m_vertexBuffer, buffer, m_size * 4 * sizeof(float));
+		m_vertexBuffer = (const vec4*)buffer;
+		m_vertexOwner = owner;
+		m_version++;
+	}
+
+	void VertexBufferObject::MoveVertexBuffer(std::vector<float>&& buffer)
+	{
+		std::shared_ptr<std::vector<float>> owner = MoveToOwner(std::move(buffer));
+		ViewVertexBuffer(owner->data(), (uint32)owner->size(), owner);
 	}
 
 	const vec4* VertexBufferObject::GetPos(uint32 index) const
@@ -58,26 +82,49 @@ namespace soft3d
 
 	void VertexBufferObject::CopyColorBuffer(const void* buffer, uint32 size)
 	{
-		if (m_colorBuffer != nullptr)
-			delete[] m_colorBuffer;
-		m_colorBuffer = new uint32[size];
-		memcpy(m_colorBuffer, buffer, size * sizeof(uint32));
+		std::shared_ptr<std::vector<uint32>> copy = CopyToVector<uint32>(buffer, size);
+		ViewColorBuffer(copy->data(), size, copy);
+	}
+
+	void VertexBufferObject::ViewColorBuffer(const void* buffer, uint32 size, const std::shared_ptr<const void>& owner)
+	{
+		m_colorSize = size;
+		m_colorBuffer = (const uint32*)buffer;
+		m_colorOwner = owner;
+		m_version++;
+	}
+
+	void VertexBufferObject::MoveColorBuffer(std::vector<uint32>&& buffer)
+	{
+		std::shared_ptr<std::vector<uint32>> owner = MoveToOwner(std::move(buffer));
+		ViewColorBuffer(owner->data(), (uint32)owner->size(), owner);
 	}
 
 	const uint32* VertexBufferObject::GetColor(uint32 index) const
 	{
-		if (m_colorBuffer == nullptr || index >= m_size)
+		if (m_colorBuffer == nullptr || index >= m_size || index >= m_colorSize)
 			return nullptr;
 		return (uint32*)&(m_colorBuffer[index]);
 	}
 
 	void VertexBufferObject::CopyIndexBuffer(const void* buffer, uint32 size)
 	{
-		if (m_indexBuffer != nullptr)
-			delete[] m_indexBuffer;
+		std::shared_ptr<std::vector<uint32>> copy = CopyToVector<uint32>(buffer, size);
+		ViewIndexBuffer(copy->data(), size, copy);
+	}
+
+	void VertexBufferObject::ViewIndexBuffer(const void* buffer, uint32 size, const std::shared_ptr<const void>& owner)
+	{
 		m_indexSize = size;
-		m_indexBuffer = new uint32[size];
-		memcpy(m_indexBuffer, buffer, size * sizeof(uint32));
+		m_indexBuffer = (const uint32*)buffer;
+		m_indexOwner = owner;
+		m_version++;
+	}
+
+	void VertexBufferObject::MoveIndexBuffer(std::vector<uint32>&& buffer)
+	{
+		std::shared_ptr<std::vector<uint32>> owner = MoveToOwner(std::move(buffer));
+		ViewIndexBuffer(owner->data(), (uint32)owner->size(), owner);
 	}
 
 	uint32 VertexBufferObject::GetIndex(uint32 index)
@@ -90,16 +137,27 @@ namespace soft3d
 
 	void VertexBufferObject::CopyUVBuffer(const void* buffer, uint32 size)
 	{
-		if (m_uvBuffer != nullptr)
-			delete[] m_uvBuffer;
-		uint32 uvsize = size / 2;
-		m_uvBuffer = new vec2[uvsize];
-		memcpy(m_uvBuffer, buffer, uvsize * 2 * sizeof(void*));
+		std::shared_ptr<std::vector<float>> copy = CopyToVector<float>(buffer, size / 2 * 2);
+		ViewUVBuffer(copy->data(), size, copy);
+	}
+
+	void VertexBufferObject::ViewUVBuffer(const void* buffer, uint32 size, const std::shared_ptr<const void>& owner)
+	{
+		m_uvSize = size / 2;
+		m_uvBuffer = (const vec2*)buffer;
+		m_uvOwner = owner;
+		m_version++;
+	}
+
+	void VertexBufferObject::MoveUVBuffer(std::vector<float>&& buffer)
+	{
+		std::shared_ptr<std::vector<float>> owner = MoveToOwner(std::move(buffer));
+		ViewUVBuffer(owner->data(), (uint32)owner->size(), owner);
 	}
 
 	const vec2* VertexBufferObject::GetUV(uint32 index) const
 	{
-		if (m_indexBuffer != nullptr)
+		if (m_indexBuffer != nullptr && m_attributeLayout == ATTRIBUTES_PER_INDEX)
 		{
 			if (index >= m_indexSize)
 				return nullptr;
@@ -109,24 +167,48 @@ namespace soft3d
 			if (index >= m_size)
 				return nullptr;
 		}
-		if (m_uvBuffer == nullptr)
+		if (m_uvBuffer == nullptr || index >= m_uvSize)
 			return nullptr;
 		return &(m_uvBuffer[index]);
 	}
 
 	void VertexBufferObject::CopyNormalBuffer(const void* buffer, uint32 size)
 	{
-		if (m_normalBuffer != nullptr)
-			delete[] m_normalBuffer;
-		size /= 3;
-		m_normalBuffer = new vec3[size];
-		memcpy(m_normalBuffer, buffer, size * 3 * sizeof(float));
+		std::shared_ptr<std::vector<float>> copy = CopyToVector<float>(buffer, size / 3 * 3);
+		ViewNormalBuffer(copy->data(), size, copy);
+	}
+
+	void VertexBufferObject::ViewNormalBuffer(const void* buffer, uint32 size, const std::shared_ptr<const void>& owner)
+	{
+		m_normalSize = size / 3;
+		m_normalBuffer = (const vec3*)buffer;
+		m_normalOwner = owner;
+		m_version++;
+	}
+
+	void VertexBufferObject::MoveNormalBuffer(std::vector<float>&& buffer)
+	{
+		std::shared_ptr<std::vector<float>> owner = MoveToOwner(std::move(buffer));
+		ViewNormalBuffer(owner->data(), (uint32)owner->size(), owner);
 	}
 
 	const vec3* VertexBufferObject::GetNormal(uint32 index) const
 	{
-		if (m_normalBuffer == nullptr || index >= m_indexSize)
+		uint32 count = m_indexBuffer != nullptr && m_attributeLayout == ATTRIBUTES_PER_INDEX ? m_indexSize : m_size;
+		if (m_normalBuffer == nullptr || index >= count || index >= m_normalSize)
 			return nullptr;
 		return &(m_normalBuffer[index]);
 	}
+
+	void VertexBufferObject::AdoptMeshCache(const std::shared_ptr<MeshCache>& cache, uint32 mesh)
+	{
+		//each view holds the cache, so it is unmapped once the last of them is replaced
+		const MeshCache::Mesh& m = cache->GetMesh(mesh);
+		ViewVertexBuffer(m.vertices, m.vertexCount * 4, cache);
+		ViewIndexBuffer(m.indices, m.indexCount, cache);
+		ViewNormalBuffer(m.normals, m.normalCount * 3, cache);
+		ViewUVBuffer(m.uvs, m.uvCount * 2, cache);
+		m_attributeLayout = ATTRIBUTES_PER_VERTEX;
+		m_version++;
+	}
 }
\ No newline at end of file
@@ -1,8 +1,11 @@
 #pragma once
+#include <vector>
 
 namespace soft3d
 {
 
+	class MeshCache;
+
 	class VertexBufferObject
 	{
 	public:
@@ -15,6 +18,25 @@ namespace soft3d
 		void CopyUVBuffer(const void* buffer, uint32 size);
 		void CopyNormalBuffer(const void* buffer, uint32 size);
 
+		//non-owning views, sizes count floats/uint32 like the Copy* methods;
+		//owner is released once the view is replaced or the vbo dies, a custom deleter on it works as lifetime hook
+		void ViewVertexBuffer(const void* buffer, uint32 size, const std::shared_ptr<const void>& owner = nullptr);
+		void ViewIndexBuffer(const void* buffer, uint32 size, const std::shared_ptr<const void>& owner = nullptr);
+		void ViewColorBuffer(const void* buffer, uint32 size, const std::shared_ptr<const void>& owner = nullptr);
+		void ViewUVBuffer(const void* buffer, uint32 size, const std::shared_ptr<const void>& owner = nullptr);
+		void ViewNormalBuffer(const void* buffer, uint32 size, const std::shared_ptr<const void>& owner = nullptr);
+
+		//take over a buffer built by the caller without copying it
+		void MoveVertexBuffer(std::vector<float>&& buffer);
+		void MoveIndexBuffer(std::vector<uint32>&& buffer);
+		void MoveColorBuffer(std::vector<uint32>&& buffer);
+		void MoveUVBuffer(std::vector<float>&& buffer);
+		void MoveNormalBuffer(std::vector<float>&& buffer);
+
+		//positions, indices, normals and uvs of one cached mesh become views into the cache,
+		//the mesh transform is left to the caller
+		void AdoptMeshCache(const std::shared_ptr<MeshCache>& cache, uint32 mesh = 0);
+
 		const vmath::vec4* GetPos(uint32 index) const;
 		const uint32* GetColor(uint32 index) const;
 		const vmath::vec3* GetNormal(uint32 index) const;
@@ -36,6 +58,15 @@ namespace soft3d
 			return m_uvBuffer != nullptr;
 		}
 
+		//bumped by every View*, Copy*, Move* and AdoptMeshCache, the pipeline reuses transformed vertices while it holds;
+		//call MarkDirty after writing into viewed memory or changing m_attributeLayout
+		inline uint32 GetVersion() const {
+			return m_version;
+		}
+		inline void MarkDirty() {
+			m_version++;
+		}
+
 
 		enum RENDER_MODE
 		{
@@ -50,27 +81,49 @@ namespace soft3d
 			CULL_NONE,
 		};
 
-		enum UNIFORM_RELATIVE
+		//what normals and uvs are indexed by
+		enum ATTRIBUTE_LAYOUT
 		{
-			MAX_UNIFORM_COUNT = 16,
+			ATTRIBUTES_PER_INDEX,//one entry per index, as the raw fbx layers come
+			ATTRIBUTES_PER_VERTEX,//one entry per position, welded meshes share them through the index buffer
 		};
 
+		//index of the normal and uv of the i-th vertex drawn
+		inline uint32 GetAttributeIndex(uint32 index) {
+			if (m_attributeLayout == ATTRIBUTES_PER_VERTEX && useIndex())
+				return GetIndex(index);
+			return index;
+		}
+
 	public:
 		RENDER_MODE m_mode;
 		CULL_MODE m_cullMode;
+		ATTRIBUTE_LAYOUT m_attributeLayout;
 
 	private:
-		vmath::vec4* m_vertexBuffer;
+		//every buffer is a view, the owner keeps its storage alive whether that is
+		//a copy, a moved in vector, a mapped cache or caller memory
+		const vmath::vec4* m_vertexBuffer;
+		std::shared_ptr<const void> m_vertexOwner;
 		uint32 m_size;
 
-		uint32* m_colorBuffer;
+		const uint32* m_colorBuffer;
+		std::shared_ptr<const void> m_colorOwner;
+		uint32 m_colorSize;//entries in the viewed buffer, the getters never read past it
 
-		uint32* m_indexBuffer;
+		const uint32* m_indexBuffer;
+		std::shared_ptr<const void> m_indexOwner;
 		uint32 m_indexSize;
 
-		vmath::vec2* m_uvBuffer;
+		const vmath::vec2* m_uvBuffer;
+		std::shared_ptr<const void> m_uvOwner;
+		uint32 m_uvSize;
+
+		const vmath::vec3* m_normalBuffer;
+		std::shared_ptr<const void> m_normalOwner;
+		uint32 m_normalSize;
 
-		vmath::vec3* m_normalBuffer;
+		uint32 m_version;
 	};
 
 }
@@ -31,7 +31,11 @@ namespace soft3d
 
 	void VS_OUT::Interpolate(const VS_OUT* vo0, const VS_OUT* vo1, const VS_OUT* vo2, float ratio0, float ratio1, float ratio2)
 	{
-		this->color = vo0->color * ratio0 + vo1->color * ratio1 + vo2->color * ratio2;
+		//flat colors, as every instance tint is, stay exact instead of losing bits to truncation
+		if ((uint32)vo0->color == (uint32)vo1->color && (uint32)vo1->color == (uint32)vo2->color)
+			this->color = vo0->color;
+		else
+			this->color = vo0->color * ratio0 + vo1->color * ratio1 + vo2->color * ratio2;
 		this->uv[0] = (vo0->uv[0] * ratio0 + vo1->uv[0] * ratio1 + vo2->uv[0] * ratio2) / this->rhw;
 		this->uv[1] = (vo0->uv[1] * ratio0 + vo1->uv[1] * ratio1 + vo2->uv[1] * ratio2) / this->rhw;
 
@@ -56,28 +60,65 @@ namespace soft3d
 		this->instanceID = vo0->instanceID;
 	}
 
+	void VS_OUT::InterpolateUVDeriv(const VS_OUT* vo0, const VS_OUT* vo1, const VS_OUT* vo2, uint32 x, uint32 y)
+	{
+		//screen space barycentric gradients are constant over the triangle
+		float x1 = vo0->pos[0], y1 = vo0->pos[1];
+		float x2 = vo1->pos[0], y2 = vo1->pos[1];
+		float x3 = vo2->pos[0], y3 = vo2->pos[1];
+		float D = (y1 - y3)*(x2 - x3) - (x1 - x3)*(y2 - y3);
+		if (D == 0.0f)
+		{
+			this->duvdx = vec2(0.0f);
+			this->duvdy = vec2(0.0f);
+			return;
+		}
+		float r0dx = -(y2 - y3) / D;
+		float r0dy = (x2 - x3) / D;
+		float r1dx = (y1 - y3) / D;
+		float r1dy = -(x1 - x3) / D;
+
+		vec2 Ux = (vo0->uv - vo2->uv) * r0dx + (vo1->uv - vo2->uv) * r1dx;
+		vec2 Uy = (vo0->uv - vo2->uv) * r0dy + (vo1->uv - vo2->uv) * r1dy;
+		float Rx = (vo0->rhw - vo2->rhw) * r0dx + (vo1->rhw - vo2->rhw) * r1dx;
+		float Ry = (vo0->rhw - vo2->rhw) * r0dy + (vo1->rhw - vo2->rhw) * r1dy;
+
+		//every pixel of a 2x2 quad takes its derivatives at the quad origin, so the quad shares one lod
+		float ox = (float)(int)((x & ~1u) - x);
+		float oy = (float)(int)((y & ~1u) - y);
+		float Rq = this->rhw + Rx * ox + Ry * oy;
+		vec2 Uq = this->uv * this->rhw + Ux * ox + Uy * oy;
+		vec2 uvq = Uq / Rq;
+		this->duvdx = (Ux - uvq * Rx) / Rq;
+		this->duvdy = (Uy - uvq * Ry) / Rq;
+	}
+
 
 	void VertexProcessor::Process()
 	{
-		mat4* mv_matrix = (mat4*)(uniforms[UNIFORM_MV_MATRIX]);
-		mat4* proj_matrix = (mat4*)(uniforms[UNIFORM_PROJ_MATRIX]);
-		vec3* light_pos = (vec3*)(uniforms[UNIFORM_LIGHT_POS]);
-		vec3* light_dir = (vec3*)(uniforms[UNIFORM_LIGHT_DIR]);
-		vec4 P = (*mv_matrix) * (*pos);
-		if (normal != nullptr && (light_pos != nullptr || light_dir != nullptr))
+		const mat4& mv_matrix = instance_mv != nullptr ? *instance_mv : uniforms->mv_matrix;
+		vec4 P = mv_matrix * (*pos);
+		if (normal != nullptr && uniforms->light_mode != DefaultUniforms::LIGHT_NONE)
 		{
 			vs_out.mode = VS_OUT::LIGHT_MODE;
-			vs_out.N = mat3(*mv_matrix) * (*normal);
-			if (light_dir != nullptr)
-				vs_out.L = -*light_dir;
+			vs_out.color = instance_color != nullptr ? *instance_color : 0xffffffff;
+			vs_out.N = mat3(mv_matrix) * (*normal);
+			if (uniforms->light_mode == DefaultUniforms::LIGHT_DIRECTIONAL)
+				vs_out.L = -uniforms->light_dir;
 			else
-				vs_out.L = *light_pos - P.xyz();
+				vs_out.L = uniforms->light_pos - P.xyz();
 			vs_out.V = -P.xyz();
 			vs_out.H = (vs_out.V + vs_out.L) / 2.0f;
 		}
 		else
 		{
+			//vertex colors stay ignored under a texture, instance tints are not
 			vs_out.mode = VS_OUT::TEXTURE_MODE;
+			if (instance_color != nullptr)
+			{
+				vs_out.mode = VS_OUT::TINTED_TEXTURE_MODE;
+				vs_out.color = *instance_color;
+			}
 		}
 
 		//vs_out.N = normalize(vs_out.N);
@@ -90,7 +131,7 @@ namespace soft3d
 		//vec3 specular = pow(vmath::max<float>(dot(R, vs_out.V), 0.0f), 4.0f) * vec3(0.7f, 0.7f, 0.7f);
 		//vec3 finalcolor = diffuse + specular + vec3(0.1f);
 
-		vs_out.pos = (*proj_matrix) * P;
+		vs_out.pos = uniforms->proj_matrix * P;
 		//vs_out.color = fC2uC(finalcolor);
 	}
 
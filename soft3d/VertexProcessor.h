@@ -3,7 +3,24 @@
 namespace soft3d
 {
 
-	typedef void* UniformPtr;
+	//uniform block of the default VertexProcessor, Soft3dPipeline::SetUniforms copies it into the frame arena
+	struct DefaultUniforms
+	{
+		enum LIGHT_MODE
+		{
+			LIGHT_NONE,//texture only
+			LIGHT_DIRECTIONAL,//light_dir is used
+			LIGHT_POINT,//light_pos is used, in view space
+		};
+
+		vmath::mat4 mv_matrix = vmath::mat4::identity();
+		vmath::mat4 proj_matrix = vmath::mat4::identity();
+		vmath::mat4 view_matrix = vmath::mat4::identity();
+		//initialized like the rest, SetUniforms compares whole blocks to spot changes
+		vmath::vec3 light_dir = vmath::vec3(0.0f, 0.0f, 0.0f);
+		vmath::vec3 light_pos = vmath::vec3(0.0f, 0.0f, 0.0f);
+		LIGHT_MODE light_mode = LIGHT_NONE;
+	};
 
 	struct VS_OUT
 	{
@@ -12,11 +29,14 @@ namespace soft3d
 			LIGHT_MODE,
 			COLOR_MODE,
 			TEXTURE_MODE,
+			TINTED_TEXTURE_MODE,//texture times the interpolated color, for instance tints
 		};
 		vmath::vec4 pos;
 		Color color = Color::purple;
 		const vmath::vec3 normal;
 		vmath::vec2 uv;
+		vmath::vec2 duvdx;
+		vmath::vec2 duvdy;
 		float rhw;
 
 		vmath::vec3 N;
@@ -32,6 +52,7 @@ namespace soft3d
 		void Interpolate(const VS_OUT* vo0, const VS_OUT* vo1, float ratio0, float ratio1);
 		void Interpolate(const VS_OUT* vo0, const VS_OUT* vo1, const VS_OUT* vo2, float ratio0, float ratio1, float ratio2);
 		float InterpolateRHW(const VS_OUT* vo0, const VS_OUT* vo1, const VS_OUT* vo2, float ratio0, float ratio1, float ratio2);
+		void InterpolateUVDeriv(const VS_OUT* vo0, const VS_OUT* vo1, const VS_OUT* vo2, uint32 x, uint32 y);
 	};
 
 	struct VertexProcessor
@@ -43,7 +64,10 @@ namespace soft3d
 		const vmath::vec3* normal = nullptr;
 
 		VS_OUT vs_out;
-		UniformPtr* uniforms = nullptr;
+		const DefaultUniforms* uniforms = nullptr;
+		//set by instanced draws: replaces the mv_matrix uniform, tints the lit color
+		const vmath::mat4* instance_mv = nullptr;
+		const uint32* instance_color = nullptr;
 	};
 
 }
\ No newline at end of file
@@ -22,7 +22,7 @@ namespace soft3d
 		}
 	}
 
-	void VertexProcessorUnit::SetData(std::shared_ptr<PipeLineData> pipeData, std::shared_ptr<VertexBufferObject> vbo, UniformStack uniform)
+	void VertexProcessorUnit::SetData(std::shared_ptr<PipeLineData> pipeData, std::shared_ptr<VertexBufferObject> vbo, const DefaultUniforms* uniform)
 	{
 		boost::unique_lock<boost::shared_mutex> wlock(m_rwmutex);
 		m_pipeData = pipeData;
@@ -58,10 +58,12 @@ namespace soft3d
 					cur_vp.color = colorptr;
 				else
 					cur_vp.color = (uint32*)this;//ɫ
-				cur_vp.normal = m_vbo->GetNormal(i);
+				uint32 attr = m_vbo->GetAttributeIndex(i);
+				cur_vp.normal = m_vbo->GetNormal(attr);
 
-				if (m_vbo->hasUV())
-					cur_vp.vs_out.uv = *(m_vbo->GetUV(i));
+				const vmath::vec2* uv = m_vbo->GetUV(attr);
+				if (uv != nullptr)
+					cur_vp.vs_out.uv = *uv;
 
 				cur_vp.uniforms = m_uniform;
 				cur_vp.Process();//һͼ任ͶӰ任
@@ -74,8 +76,8 @@ namespace soft3d
 				cur_vp.vs_out.pos[3] = 1.0f;
 				cur_vp.vs_out.rhw = rhw;
 
-				cur_vp.vs_out.pos[0] = (cur_vp.vs_out.pos[0] + 1.0f) * 0.5f * Soft3dPipeline::Instance()->GetWidth();
-				cur_vp.vs_out.pos[1] = (cur_vp.vs_out.pos[1] + 1.0f) * 0.5f * Soft3dPipeline::Instance()->GetHeight();
+				cur_vp.vs_out.pos[0] = (cur_vp.vs_out.pos[0] + 1.0f) * 0.5f * Soft3dPipeline::Instance()->GetRenderWidth();
+				cur_vp.vs_out.pos[1] = (cur_vp.vs_out.pos[1] + 1.0f) * 0.5f * Soft3dPipeline::Instance()->GetRenderHeight();
 
 				cur_vp.vs_out.uv *= rhw;//uvwԺ˻Ϊȷuv
 			}
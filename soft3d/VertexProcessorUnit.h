@@ -12,7 +12,7 @@ namespace soft3d
 	public:
 		VertexProcessorUnit(int threadCount = 2);
 		virtual ~VertexProcessorUnit();
-		void SetData(std::shared_ptr<PipeLineData> pipeData, std::shared_ptr<VertexBufferObject> vbo, UniformStack uniform);
+		void SetData(std::shared_ptr<PipeLineData> pipeData, std::shared_ptr<VertexBufferObject> vbo, const DefaultUniforms* uniform);
 		void ThreadFun(int id);
 
 	private:
@@ -20,7 +20,7 @@ namespace soft3d
 		int m_threadCount;
 		std::shared_ptr<PipeLineData> m_pipeData;
 		std::shared_ptr<VertexBufferObject> m_vbo;
-		UniformStack m_uniform;
+		const DefaultUniforms* m_uniform;
 
 		boost::shared_mutex m_rwmutex;
 	};
@@ -2,10 +2,26 @@
 //
 #include <Windows.h>
 #include "soft3d.h"
+#include "SamplerBenchmark.h"
+#include "SkinningBenchmark.h"
 #include "Resource.h"
 
 #define MAX_LOADSTRING 100
 
+//client size of the window and of the frame buffers, -width and -height on the command line
+int frameWidth = 800;
+int frameHeight = 600;
+
+//the number following name on the command line, def when it is missing or not positive
+double CommandLineValue(LPCWSTR cmdLine, LPCWSTR name, double def)
+{
+	const wchar_t* arg = wcsstr(cmdLine, name);
+	if (arg == nullptr)
+		return def;
+	double value = _wtof(arg + wcslen(name));
+	return value > 0.0 ? value : def;
+}
+
 void QuitProgram(const soft3d::DIKEYBOARD dikeyboard)
 {
 	if (dikeyboard[DIK_ESCAPE] & 0x80)
@@ -33,7 +49,33 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
                      _In_ int       nCmdShow)
 {
     UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
+    if (wcsstr(lpCmdLine, L"-samplerbench") != nullptr)
+    {
+        FILE* out = fopen("sampler_bench.txt", "w");
+        if (out != nullptr)
+        {
+            soft3d::SamplerBenchmark::Report(out);
+            fclose(out);
+        }
+        return 0;
+    }
+    if (wcsstr(lpCmdLine, L"-skinbench") != nullptr)
+    {
+        FILE* out = fopen("skinning_bench.txt", "w");
+        if (out != nullptr)
+        {
+            soft3d::SkinningBenchmark::Report(out);
+            fclose(out);
+        }
+        return 0;
+    }
+    //64 to 8192 pixels on each side
+    frameWidth = std::min(std::max((int)CommandLineValue(lpCmdLine, L"-width", 800), 64), 8192);
+    frameHeight = std::min(std::max((int)CommandLineValue(lpCmdLine, L"-height", 600), 64), 8192);
+    //-dynres <ms>: lowers the render resolution while frames take longer than that
+    float targetFrameMs = (float)CommandLineValue(lpCmdLine, L"-dynres", 0.0);
+    //-budget <ms>: lowers shading quality while frames take longer than that
+    float frameBudgetMs = (float)CommandLineValue(lpCmdLine, L"-budget", 0.0);
 
     // TODO: ڴ˷ô롣
 
@@ -49,7 +91,11 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
     }
 
     //HACCEL hAccelTable = LoadAccelerators(hInstance, MAKEINTRESOURCE(IDC_SOFT3D));
-	soft3d::Soft3dPipeline::Instance()->InitPipeline(hInstance, hWnd, 800, 600);
+	soft3d::Soft3dPipeline::Instance()->InitPipeline(hInstance, hWnd, frameWidth, frameHeight);
+	if (targetFrameMs > 0.0f)
+		soft3d::Soft3dPipeline::Instance()->SetDynamicResolution(targetFrameMs);
+	if (frameBudgetMs > 0.0f)
+		soft3d::Soft3dPipeline::Instance()->SetFrameBudget(frameBudgetMs);
 	soft3d::Soft3dPipeline::Instance()->AddKeyboardEventCB(QuitProgram);
 	soft3d::Soft3dPipeline::Instance()->GetFocus();
     MSG msg;
@@ -113,8 +159,12 @@ BOOL InitInstance(HINSTANCE hInstance, int nCmdShow)
 {
    hInst = hInstance; // ʵ洢ȫֱ
 
-   hWnd = CreateWindowW(szWindowClass, szTitle, WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU | WS_MINIMIZEBOX,
-      CW_USEDEFAULT, CW_USEDEFAULT, 800, 600, nullptr, nullptr, hInstance, nullptr);
+   //the swap chain takes the client size, which has to match the frame buffers
+   DWORD style = WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU | WS_MINIMIZEBOX;
+   RECT rect = { 0, 0, frameWidth, frameHeight };
+   AdjustWindowRect(&rect, style, FALSE);
+   hWnd = CreateWindowW(szWindowClass, szTitle, style,
+      CW_USEDEFAULT, CW_USEDEFAULT, rect.right - rect.left, rect.bottom - rect.top, nullptr, nullptr, hInstance, nullptr);
 
    if (!hWnd)
    {
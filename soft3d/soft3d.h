@@ -8,6 +8,7 @@ namespace soft3d
 
 	typedef unsigned short uint16;
 	typedef unsigned int uint32;
+	typedef unsigned long long uint64;
 
 	inline void uC2fC(uint32 color, vmath::vec4* colorf)
 	{